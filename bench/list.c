@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * list - pointer-chasing: build, reverse and walk linked lists of structs
+ */
+struct node {
+	int key;
+	int val;
+	struct node *next;
+};
+
+struct node *push(struct node *head, int key) {
+	struct node *n;
+
+	n = (struct node *) malloc(sizeof(struct node));
+	n->key = key;
+	n->val = key * 3 & 255;
+	n->next = head;
+	return n;
+}
+
+struct node *reverse(struct node *head) {
+	struct node *prev, *next;
+
+	prev = 0;
+	while (head) {
+		next = head->next;
+		head->next = prev;
+		prev = head;
+		head = next;
+	}
+	return prev;
+}
+
+int main(void) {
+	struct node *head, *n;
+	int i, round, sum;
+
+	head = 0;
+	for (i = 0; i < 2000; i++)
+		head = push(head, i * 17 % 1009);
+	sum = 0;
+	for (round = 0; round < 100; round++) {
+		head = reverse(head);
+		for (n = head; n; n = n->next)
+			if (n->key & 1)
+				sum = (sum + n->val) & 16777215;
+	}
+	printf("%d\n", sum);
+	return 0;
+}
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * matmul - arithmetic-heavy: integer matrix multiply with row-major indexing
+ */
+int main(void) {
+	int *a, *b, *c;
+	int n, i, j, k, sum;
+
+	n = 80;
+	a = (int *) malloc(n * n * sizeof(int));
+	b = (int *) malloc(n * n * sizeof(int));
+	c = (int *) malloc(n * n * sizeof(int));
+	for (i = 0; i < n * n; i++) {
+		a[i] = i % 7 - 3;
+		b[i] = i % 11 - 5;
+	}
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			sum = 0;
+			for (k = 0; k < n; k++)
+				sum = sum + a[i * n + k] * b[k * n + j];
+			c[i * n + j] = sum;
+		}
+	}
+	sum = 0;
+	for (i = 0; i < n * n; i++)
+		sum = (sum * 31 + c[i]) & 16777215;
+	printf("%d\n", sum);
+	return 0;
+}
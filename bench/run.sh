@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# run.sh - run the benchmark programs through maxcc and the host compiler
+#
+# $ bench/run.sh [program.c ...]
+#
+# Every program is run once per maxcc execution mode (MODES, "vm" or the flag
+# passed next to --run) and once as a gcc -O0 and a gcc -O2 binary. The
+# output of every run has to match gcc -O0. For each run the best wall time
+# of REPEAT runs is reported, for maxcc also the number of VM instructions
+# it dispatched, and the ratio of the time to gcc -O0 and gcc -O2. When
+# perf is installed, the host instructions retired are reported as well.
+# --jobs=4 is a compile option rather than an engine: it runs the stack VM
+# on code emitted by the codegen threads, so it checks their output too.
+
+MAXCC=${MAXCC:-./maxcc}
+CC=${CC:-gcc}
+MODES=${MODES:-"vm --reg-vm --jobs=4"}
+REPEAT=${REPEAT:-3}
+
+tmp=$(mktemp -d)
+trap 'rm -rf $tmp' EXIT
+
+[ $# -eq 0 ] && set -- bench/*.c
+perf=
+perf stat -x, -e instructions true > /dev/null 2>&1 && perf=perf
+
+now() {
+	date +%s%N
+}
+
+# measure <name> <command...> - best time in ms of REPEAT runs into $ms,
+# the output of the last run in $tmp/<name>.out and its stderr in
+# $tmp/<name>.err
+measure() {
+	name=$1
+	shift
+	ms=
+	i=0
+	while [ $i -lt $REPEAT ]; do
+		start=$(now)
+		"$@" > $tmp/$name.out 2> $tmp/$name.err
+		end=$(now)
+		t=$(((end - start) / 1000000))
+		[ -z "$ms" ] || [ $t -lt $ms ] && ms=$t
+		i=$((i + 1))
+	done
+	insns=-
+	if [ -n "$perf" ]; then
+		insns=$($perf stat -x, -e instructions "$@" 2>&1 > /dev/null | awk -F, '/instructions/ { print $1 }')
+	fi
+}
+
+# ratio <ms> <base ms> - ms / base with one decimal, base clamped to 1 ms
+ratio() {
+	b=$2
+	[ $b -lt 1 ] && b=1
+	echo "$(($1 / b)).$(($1 * 10 / b % 10))"
+}
+
+fail=0
+printf "%-10s %-10s %8s %12s %14s %8s %8s\n" program mode ms vm-insns host-insns x-O0 x-O2
+for src in "$@"; do
+	prog=$(basename $src .c)
+	$CC -w -O0 -o $tmp/$prog-O0 $src && $CC -w -O2 -o $tmp/$prog-O2 $src || exit 2
+
+	measure O0 $tmp/$prog-O0
+	o0=$ms
+	printf "%-10s %-10s %8d %12s %14s %8s %8s\n" $prog gcc-O0 $ms - $insns 1.0 -
+	measure O2 $tmp/$prog-O2
+	o2=$ms
+	printf "%-10s %-10s %8d %12s %14s %8s %8s\n" $prog gcc-O2 $ms - $insns $(ratio $ms $o0) 1.0
+	if ! cmp -s $tmp/O0.out $tmp/O2.out; then
+		echo "$prog: gcc -O0 and -O2 disagree"
+		exit 2
+	fi
+
+	for mode in $MODES; do
+		flags=
+		[ $mode = vm ] || flags=$mode
+		measure maxcc $MAXCC $flags --run --stats $src
+		vm=$(awk '/^instructions:/ { print $2 }' $tmp/maxcc.err)
+		printf "%-10s %-10s %8d %12s %14s %8s %8s\n" $prog $mode $ms ${vm:--} $insns $(ratio $ms $o0) $(ratio $ms $o2)
+		if ! cmp -s $tmp/O0.out $tmp/maxcc.out; then
+			echo "$prog: maxcc $mode output differs from gcc"
+			fail=$((fail + 1))
+		fi
+	done
+done
+[ $fail -eq 0 ]
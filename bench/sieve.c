@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * sieve - array-heavy: the sieve of Eratosthenes over a char array
+ */
+int main(void) {
+	char *flags;
+	int n, i, j, count, round;
+
+	n = 200000;
+	flags = (char *) malloc(n + 1);
+	for (round = 0; round < 5; round++) {
+		memset(flags, 1, n + 1);
+		count = 0;
+		for (i = 2; i <= n; i++) {
+			if (flags[i]) {
+				count++;
+				for (j = i + i; j <= n; j = j + i)
+					flags[j] = 0;
+			}
+		}
+	}
+	printf("%d\n", count);
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * state - branch-heavy: a switch-driven tokenizer over a generated buffer,
+ * the states are 0 (space), 1 (word), 2 (number) and 3 (punctuation)
+ */
+
+int main(void) {
+	char *buf;
+	int len, i, c, state, words, numbers, puncts, value;
+
+	len = 200000;
+	buf = (char *) malloc(len);
+	for (i = 0; i < len; i++) {
+		c = (i * 31 + i / 7) % 23;
+		if (c < 5)
+			buf[i] = ' ';
+		else if (c < 13)
+			buf[i] = 'a' + c;
+		else if (c < 19)
+			buf[i] = '0' + c - 13;
+		else
+			buf[i] = ';';
+	}
+	state = 0;
+	words = numbers = puncts = value = 0;
+	for (i = 0; i < len; i++) {
+		c = buf[i];
+		switch (state) {
+		case 0:
+			if (c >= 'a' && c <= 'z') {
+				words++;
+				state = 1;
+			} else if (c >= '0' && c <= '9') {
+				numbers++;
+				value = c - '0';
+				state = 2;
+			} else if (c == ';') {
+				puncts++;
+				state = 3;
+			}
+			break;
+		case 1:
+			if (c == ' ')
+				state = 0;
+			else if (c == ';') {
+				puncts++;
+				state = 3;
+			}
+			break;
+		case 2:
+			if (c >= '0' && c <= '9')
+				value = (value * 10 + c - '0') & 65535;
+			else
+				state = 0;
+			break;
+		case 3:
+			switch (c) {
+			case ' ':
+				state = 0;
+				break;
+			case ';':
+				puncts++;
+				break;
+			default:
+				state = 0;
+			}
+			break;
+		}
+	}
+	printf("%d %d %d %d\n", words, numbers, puncts, value);
+	return 0;
+}
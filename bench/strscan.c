@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * strscan - library-heavy: count the matches of a word at every position of
+ * a text buffer with memcmp
+ */
+int main(void) {
+	char *text, *word, *p;
+	int len, i, count;
+
+	len = 100000;
+	text = (char *) malloc(len);
+	for (i = 0; i < len; i++)
+		text[i] = 'a' + (i + i / 9) % 5;
+	word = "abcd";
+	count = 0;
+	p = text;
+	while (p < text + len - 4) {
+		if (*p == *word && !memcmp(p, word, 4))
+			count++;
+		if (!memcmp(p, "eab", 3))
+			count = count + 2;
+		p++;
+	}
+	printf("%d\n", count);
+	return 0;
+}
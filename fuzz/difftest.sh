@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# difftest.sh - differential testing of maxcc against the host compiler
+#
+# $ fuzz/difftest.sh [count] [first seed]
+#
+# Every seed is turned into a program by gen_program and compiled by both
+# gcc and maxcc. maxcc has to accept whatever gcc accepts, within a time
+# budget and without crashing, and running the program with --run has to
+# print exactly what the gcc binary prints. Programs that fail are kept in
+# fuzz/findings/ together with maxcc's output.
+
+MAXCC=${MAXCC:-./maxcc}
+GEN=${GEN:-fuzz/gen_program}
+CC=${CC:-gcc}
+TIMEOUT=${TIMEOUT:-5}
+COUNT=${1:-100}
+SEED=${2:-1}
+
+tmp=$(mktemp -d)
+trap 'rm -rf $tmp' EXIT
+mkdir -p fuzz/findings
+
+fail=0
+end=$((SEED + COUNT))
+while [ $SEED -lt $end ]; do
+	$GEN $SEED > $tmp/prog.c
+	if ! $CC -w -o $tmp/prog $tmp/prog.c 2> $tmp/cc.log; then
+		echo "seed $SEED: generated program rejected by $CC"
+		cat $tmp/cc.log
+		exit 2
+	fi
+
+	timeout $TIMEOUT $MAXCC --run $tmp/prog.c > $tmp/maxcc.log 2>&1
+	status=$?
+	verdict=
+	if [ $status -eq 124 ]; then
+		verdict=HANG
+	elif [ $status -gt 128 ]; then
+		verdict=CRASH
+	elif [ $status -ne 0 ]; then
+		verdict=REJECT
+	elif ! $tmp/prog | cmp -s - $tmp/maxcc.log; then
+		verdict=MISMATCH
+	fi
+
+	if [ -n "$verdict" ]; then
+		echo "seed $SEED: $verdict"
+		cp $tmp/prog.c fuzz/findings/seed-$SEED.c
+		cp $tmp/maxcc.log fuzz/findings/seed-$SEED.log
+		fail=$((fail + 1))
+	fi
+	SEED=$((SEED + 1))
+done
+
+echo "$fail of $COUNT programs failed"
+[ $fail -eq 0 ]
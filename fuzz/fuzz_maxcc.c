@@ -0,0 +1,98 @@
+/*
+ * fuzz_maxcc - fuzz target for the maxcc front end
+ *
+ * LLVMFuzzerTestOneInput() compiles one input from memory with a warm
+ * compiler context, the way libFuzzer calls it. Errors in the input come
+ * back through err_jmp instead of ending the process, so only crashes,
+ * hangs and memory blowups are reported.
+ *
+ * Without -DMAXCC_LIBFUZZER a standalone main() is built as well, which runs
+ * every file given on the command line (or stdin when there is none) under
+ * a time and a memory budget. That is what AFL and plain reproduction runs
+ * use:
+ *
+ *	$ afl-fuzz -i seeds -o out -- fuzz/fuzz-maxcc @@
+ *	$ MAXCC_FUZZ_TIMEOUT_MS=200 fuzz/fuzz-maxcc crash-1234
+ */
+#define MAXCC_NO_MAIN
+#include "../maxcc.c"
+
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+	init_compiler();
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *buf, size_t size) {
+	jmp_buf env;
+
+	if (!setjmp(env)) {
+		err_jmp = &env;
+		compile_buffer((char *) buf, size);
+	}
+	err_jmp = 0;
+	return 0;
+}
+
+#ifndef MAXCC_LIBFUZZER
+char *fuzz_input;
+
+void fuzz_timeout(int sig) {
+	fprintf(stderr, "fuzz-maxcc: time budget exceeded on %s\n", fuzz_input);
+	abort();
+}
+
+/*
+ * fuzz_file() - run the fuzz target on one file, or stdin for "-"
+ */
+void fuzz_file(char *path, int timeout_ms) {
+	struct itimerval budget;
+	char *buf;
+	int fd, len, n;
+
+	fuzz_input = path;
+	if ((fd = strcmp(path, "-") ? open(path, 0) : 0) < 0) {
+		fprintf(stderr, "fuzz-maxcc: couldn't open %s\n", path);
+		exit(1);
+	}
+	buf = malloc(pool_size);
+	len = 0;
+	while (len < pool_size && (n = read(fd, buf + len, pool_size - len)) > 0)
+		len += n;
+	if (fd)
+		close(fd);
+
+	memset(&budget, 0, sizeof(budget));
+	budget.it_value.tv_sec = timeout_ms / 1000;
+	budget.it_value.tv_usec = timeout_ms % 1000 * 1000;
+	setitimer(ITIMER_REAL, &budget, 0);
+	LLVMFuzzerTestOneInput((uint8_t *) buf, len);
+	memset(&budget, 0, sizeof(budget));
+	setitimer(ITIMER_REAL, &budget, 0);
+
+	free(buf);
+}
+
+int main(int argc, char **argv) {
+	struct rlimit mem;
+	char *env;
+	int timeout_ms, mem_mb;
+
+	timeout_ms = (env = getenv("MAXCC_FUZZ_TIMEOUT_MS")) ? atoi(env) : 1000;
+	mem_mb = (env = getenv("MAXCC_FUZZ_MEM_MB")) ? atoi(env) : 256;
+
+	mem.rlim_cur = mem.rlim_max = (rlim_t) mem_mb * 1024 * 1024;
+	setrlimit(RLIMIT_AS, &mem);
+	signal(SIGALRM, fuzz_timeout);
+
+	LLVMFuzzerInitialize(&argc, &argv);
+	if (argc < 2)
+		fuzz_file("-", timeout_ms);
+	while (--argc)
+		fuzz_file(*++argv, timeout_ms);
+	return 0;
+}
+#endif
@@ -0,0 +1,257 @@
+/*
+ * gen_program - generate a random program in the C subset maxcc accepts
+ *
+ * $ gen_program <seed>
+ *
+ * The program is written to stdout. It is deterministic for a given seed,
+ * terminates, and avoids undefined behaviour (every intermediate value is
+ * masked so nothing overflows, divisors are never zero, shift counts are
+ * small and variables are initialized), so the host compiler and maxcc
+ * must agree on what it prints.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+unsigned seed;
+
+int rnd(int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+// variables that can be read and assigned, and the loop counters which are only read
+char *rw_vars[] = {"l0", "l1", "a", "b", "g0", "g1", "g2", "s0.x", "s0.c", "ps->x"};
+char *ro_vars[] = {"i0", "i1", "i2"};
+
+int funcs;	// functions defined so far, the only ones that can be called
+int loops;	// loop nesting depth of the statement being generated
+
+// The order operands and arguments are evaluated in is unspecified, so
+// functions other than main only assign their locals and parameters (the
+// first four rw_vars) and don't print; a call then has no side effect the
+// output could depend on.
+int writable;
+
+void gen_expr(int depth) {
+	int k;
+
+	if (depth <= 0 || !rnd(4)) {
+		switch (rnd(4)) {
+		case 0:
+			printf("%d", rnd(100));
+			break;
+		case 1:
+			if (loops) {
+				printf("%s", ro_vars[rnd(loops)]);
+				break;
+			}
+		default:
+			printf("%s", rw_vars[rnd(sizeof(rw_vars) / sizeof(char *))]);
+		}
+		return;
+	}
+
+	--depth;
+	switch (rnd(funcs ? 14 : 13)) {
+	case 0:
+		printf("((");
+		gen_expr(depth);
+		printf(" %s ", rnd(2) ? "+" : "-");
+		gen_expr(depth);
+		printf(") & 65535)");
+		break;
+	case 1:
+		printf("((");
+		gen_expr(depth);
+		printf(" & 255) * (");
+		gen_expr(depth);
+		printf(" & 255))");
+		break;
+	case 2:
+		printf("(");
+		gen_expr(depth);
+		printf(" %s ((", rnd(2) ? "/" : "%");
+		gen_expr(depth);
+		printf(" & 15) + 1))");
+		break;
+	case 3:
+		printf("((");
+		gen_expr(depth);
+		printf(" & 255) %s (", rnd(2) ? "<<" : ">>");
+		gen_expr(depth);
+		printf(" & 7))");
+		break;
+	case 4:
+		printf("(");
+		gen_expr(depth);
+		printf(" %s ", rnd(2) ? "&" : rnd(2) ? "|" : "^");
+		gen_expr(depth);
+		printf(")");
+		break;
+	case 5:
+	case 6:
+		printf("(");
+		gen_expr(depth);
+		k = rnd(6);
+		printf(" %s ", k == 0 ? "==" : k == 1 ? "!=" : k == 2 ? "<" : k == 3 ? ">" : k == 4 ? "<=" : ">=");
+		gen_expr(depth);
+		printf(")");
+		break;
+	case 7:
+		printf("(");
+		gen_expr(depth);
+		printf(" %s ", rnd(2) ? "&&" : "||");
+		gen_expr(depth);
+		printf(")");
+		break;
+	case 8:
+		printf("(");
+		gen_expr(depth);
+		printf(" ? ");
+		gen_expr(depth);
+		printf(" : ");
+		gen_expr(depth);
+		printf(")");
+		break;
+	case 9:
+		printf("(%s", rnd(2) ? "!" : "-");
+		gen_expr(depth);
+		printf(")");
+		break;
+	case 10:
+		printf("(~");
+		gen_expr(depth);
+		printf(" & 65535)");
+		break;
+	case 11:
+		// sizeof is unsigned in the host compiler
+		printf("((int) sizeof(%s))", rnd(2) ? "int" : rnd(2) ? "char" : "struct S");
+		break;
+	case 12:
+		printf("(");
+		gen_expr(depth);
+		printf(")");
+		break;
+	case 13:
+		printf("f%d(", rnd(funcs));
+		gen_expr(depth);
+		printf(", ");
+		gen_expr(depth);
+		printf(")");
+		break;
+	}
+}
+
+void indent(int depth) {
+	while (depth--)
+		printf("\t");
+}
+
+void gen_stmts(int depth, int n, int level);
+
+void gen_stmt(int depth, int level) {
+	char *v;
+
+	indent(level);
+	switch (depth > 0 ? rnd(6) : rnd(2)) {
+	case 0:
+		printf("%s = ", rw_vars[rnd(writable)]);
+		gen_expr(3);
+		printf(";\n");
+		break;
+	case 1:
+		if (writable < sizeof(rw_vars) / sizeof(char *))
+			goto plain;
+		printf("printf(\"%%d\\n\", ");
+		gen_expr(3);
+		printf(");\n");
+		break;
+	case 2:
+		printf("if (");
+		gen_expr(2);
+		printf(") {\n");
+		gen_stmts(depth - 1, 1 + rnd(3), level + 1);
+		indent(level);
+		if (rnd(2)) {
+			printf("}\n");
+			break;
+		}
+		printf("}\n");
+		indent(level);
+		printf("else {\n");
+		gen_stmts(depth - 1, 1 + rnd(3), level + 1);
+		indent(level);
+		printf("}\n");
+		break;
+	case 3:
+		if (loops == 3)
+			goto plain;
+		v = ro_vars[loops++];
+		printf("for (%s = 0; %s < %d; %s++) {\n", v, v, 1 + rnd(5), v);
+		gen_stmts(depth - 1, 1 + rnd(3), level + 1);
+		indent(level);
+		printf("}\n");
+		--loops;
+		break;
+	case 4:
+		if (loops == 3)
+			goto plain;
+		v = ro_vars[loops++];
+		printf("%s = %d;\n", v, rnd(5));
+		indent(level);
+		printf("while (%s > 0) {\n", v);
+		gen_stmts(depth - 1, 1 + rnd(3), level + 1);
+		indent(level + 1);
+		printf("%s--;\n", v);
+		indent(level);
+		printf("}\n");
+		--loops;
+		break;
+	default:
+	plain:
+		v = rw_vars[rnd(writable)];
+		printf("%s = %s + 1;\n", v, v);
+	}
+}
+
+void gen_stmts(int depth, int n, int level) {
+	while (n--)
+		gen_stmt(depth, level);
+}
+
+void gen_body(int is_main) {
+	printf("\tint l0;\n\tint l1;\n\tint i0;\n\tint i1;\n\tint i2;\n");
+	printf("\tl0 = %d;\n\tl1 = %d;\n", rnd(100), rnd(100));
+	writable = is_main ? sizeof(rw_vars) / sizeof(char *) : 4;
+	if (is_main)
+		printf("\tps = &s0;\n");
+	gen_stmts(3, 2 + rnd(6), 1);
+}
+
+int main(int argc, char **argv) {
+	int i, n;
+
+	seed = argc > 1 ? atoi(argv[1]) : 1;
+	printf("#include <stdio.h>\n\n");
+	printf("struct S {\n\tint x;\n\tchar c;\n};\n\n");
+	printf("int g0;\nint g1;\nint g2;\nstruct S s0;\nstruct S *ps;\n\n");
+
+	// main reads a and b like the other functions do
+	printf("int a;\nint b;\n\n");
+
+	n = rnd(5);
+	for (i = 0; i < n; i++) {
+		printf("int f%d(int a, int b) {\n", i);
+		gen_body(0);
+		printf("\treturn ");
+		gen_expr(3);
+		printf(";\n}\n\n");
+		funcs++;
+	}
+
+	printf("int main(void) {\n");
+	gen_body(1);
+	printf("\tprintf(\"%%d %%d %%d %%d %%d\\n\", g0, g1, g2, s0.x, s0.c);\n");
+	printf("\treturn 0;\n}\n");
+	return 0;
+}
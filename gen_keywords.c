@@ -0,0 +1,99 @@
+/*
+ * gen_keywords - generate the perfect hash table of keywords and builtins
+ *
+ * The table is written to stdout as a C header which maxcc.c includes.
+ * It uses the same identifier hash as next() in maxcc.c, and searches a
+ * multiplier which maps every keyword to its own slot, so the lexer can
+ * recognize a keyword with one multiply, one compare and one memcmp.
+ *
+ * The order of the names is the order of the tokens and opcodes they
+ * stand for: Break..Goto, then void and main, then OPEN..EXIT.
+ */
+#include <stdio.h>
+#include <string.h>
+
+char *names[] = {
+	// C keywords
+	"break", "continue", "case", "char", "default", "else", "enum", "if",
+	"int", "return", "sizeof", "struct", "union", "switch", "for", "while",
+	"do", "goto",
+	// void and main
+	"void", "main",
+	// Syscalls / C std funcs
+	"open", "read", "close", "printf", "fprintf", "malloc", "memset",
+	"memcmp", "exit",
+	0
+};
+
+// index of the first name of each group above
+#define VOID_IDX 18
+#define MAIN_IDX 19
+#define SYSCALL_IDX 20
+
+int hashes[64];
+
+/*
+ * ident_hash() - the hash next() computes for an identifier
+ *
+ * It is computed in unsigned arithmetic, which wraps the same way the
+ * int arithmetic in next() does.
+ */
+int ident_hash(char *s) {
+	unsigned hash;
+	int len;
+
+	hash = s[0];
+	for (len = 1; s[len]; len++)
+		hash = hash * 147 + s[len];
+	return (int) ((hash << 6) + len);
+}
+
+int main() {
+	int n, i, bits;
+	unsigned mult;
+	unsigned char slot[256];
+
+	for (n = 0; names[n]; n++)
+		hashes[n] = ident_hash(names[n]);
+
+	for (bits = 6; bits <= 8; bits++) {
+		for (mult = 0x9e3779b1u; mult != 0x9e3779b1u + 2000000u; mult += 2) {
+			memset(slot, 0, sizeof(slot));
+			for (i = 0; i < n; i++) {
+				if (slot[(unsigned) hashes[i] * mult >> (32 - bits)])
+					break;
+				slot[(unsigned) hashes[i] * mult >> (32 - bits)] = i + 1;
+			}
+			if (i == n)
+				goto found;
+		}
+	}
+	fprintf(stderr, "gen_keywords: no perfect hash found\n");
+	return 1;
+
+found:
+	printf("/* keywords.h - generated by gen_keywords, do not edit */\n");
+	printf("#define KW_COUNT %d\n", n);
+	printf("#define KW_VOID %d\n", VOID_IDX);
+	printf("#define KW_MAIN %d\n", MAIN_IDX);
+	printf("#define KW_SYSCALL %d\n", SYSCALL_IDX);
+	printf("#define KW_BITS %d\n", bits);
+	printf("#define KW_MULT 0x%xu\n\n", mult);
+
+	printf("char *kw_name[KW_COUNT] = {");
+	for (i = 0; i < n; i++)
+		printf("%s\"%s\",", i % 8 ? " " : "\n\t", names[i]);
+	printf("\n};\n\n");
+
+	printf("int kw_hash[KW_COUNT] = {");
+	for (i = 0; i < n; i++)
+		printf("%s%d,", i % 6 ? " " : "\n\t", hashes[i]);
+	printf("\n};\n\n");
+
+	// slot -> index into kw_name plus one, zero for an empty slot
+	printf("unsigned char kw_slot[1 << KW_BITS] = {");
+	for (i = 0; i < (1 << bits); i++)
+		printf("%s%d,", i % 16 ? " " : "\n\t", slot[i]);
+	printf("\n};\n");
+	return 0;
+}
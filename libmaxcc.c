@@ -0,0 +1,197 @@
+/*
+ * libmaxcc - the compiler behind the API in maxcc.h
+ *
+ * Built from maxcc.c without its main(). A compile runs under err_jmp, so
+ * an error unwinds to maxcc_compile() instead of ending the process, and
+ * the results are copied into the context before the next compile reuses
+ * the pools. The compiler's globals are not part of a context: maxcc_lock
+ * serializes every compile on them, and the options the command line would
+ * take are reset for every compile, so one context can't leak them into
+ * another.
+ */
+#define MAXCC_NO_MAIN
+#include "maxcc.c"
+#include "maxcc.h"
+
+struct maxcc_diag {
+	int line;
+	char *message;
+};
+
+struct maxcc_ctx {
+	int *text;
+	int text_words, text_base;
+	char *rodata;
+	int rodata_bytes, rodata_base;
+	int bss_bytes, bss_base;
+	int entry;
+	char *ir;
+	size_t ir_size;
+	struct maxcc_diag *diags;
+	int ndiags;
+};
+
+pthread_mutex_t maxcc_lock = PTHREAD_MUTEX_INITIALIZER;
+int maxcc_ready;
+
+maxcc_ctx *maxcc_create(void) {
+	jmp_buf env;
+	maxcc_ctx *c;
+
+	if (!(c = calloc(1, sizeof(maxcc_ctx))))
+		return 0;
+	c->entry = -1;
+	pthread_mutex_lock(&maxcc_lock);
+	if (!maxcc_ready) {
+		err_quiet = 1;
+		if (!setjmp(env)) {
+			err_jmp = &env;
+			init_compiler();
+			maxcc_ready = 1;
+		}
+		err_jmp = 0;
+		err_quiet = 0;
+	}
+	pthread_mutex_unlock(&maxcc_lock);
+	if (!maxcc_ready) {
+		free(c);
+		return 0;
+	}
+	return c;
+}
+
+void maxcc_destroy(maxcc_ctx *c) {
+	if (!c)
+		return;
+	maxcc_reset(c);
+	free(c);
+}
+
+void maxcc_reset(maxcc_ctx *c) {
+	int i;
+
+	for (i = 0; i < c->ndiags; i++)
+		free(c->diags[i].message);
+	free(c->diags);
+	free(c->text);
+	free(c->rodata);
+	free(c->ir);
+	memset(c, 0, sizeof(maxcc_ctx));
+	c->entry = -1;
+}
+
+/*
+ * maxcc_diag_add() - record a diagnostic in c, dropped when out of memory
+ */
+void maxcc_diag_add(maxcc_ctx *c, int line, char *message) {
+	struct maxcc_diag *d;
+
+	if (!(d = realloc(c->diags, (c->ndiags + 1) * sizeof(struct maxcc_diag))))
+		return;
+	c->diags = d;
+	d[c->ndiags].line = line;
+	if ((d[c->ndiags].message = strdup(message)))
+		c->ndiags++;
+}
+
+/*
+ * maxcc_keep() - copy the segments of a successful compile into c
+ */
+int maxcc_keep(maxcc_ctx *c) {
+	c->text_words = text_p + 1 - text;
+	c->text_base = (int) text;
+	c->rodata_bytes = rodata_p - rodata;
+	c->rodata_base = (int) rodata;
+	c->bss_bytes = bss_p - bss;
+	c->bss_base = (int) bss;
+	if (!(c->text = malloc(c->text_words * sizeof(int))) || !(c->rodata = malloc(c->rodata_bytes + 1))) {
+		maxcc_diag_add(c, 0, "error - couldn't malloc for the segments\n");
+		return -1;
+	}
+	memcpy(c->text, text, c->text_words * sizeof(int));
+	memcpy(c->rodata, rodata, c->rodata_bytes);
+	if (id_main->class == Func && id_main->val)
+		c->entry = (int *) id_main->val - text;
+	return 0;
+}
+
+int maxcc_compile(maxcc_ctx *c, const char *src, int len, int flags) {
+	jmp_buf env;
+	FILE *ir;
+	int ret;
+
+	maxcc_reset(c);
+	pthread_mutex_lock(&maxcc_lock);
+	ir = flags & MAXCC_DUMP_IR ? open_memstream(&c->ir, &c->ir_size) : 0;
+	ir_out = ir ? ir : stdout;
+	dump_ir = ir != 0;
+	reg_vm = (flags & MAXCC_REG_VM) != 0;
+	keep_frames = whole_program = lazy_bodies = 0;
+	gen_jobs = 1;
+	time_trace = profile = pgo_gen = pgo_use = 0;
+
+	err_quiet = 1;
+	if (!setjmp(env)) {
+		err_jmp = &env;
+		compile_buffer((char *) src, len);
+		ret = 0;
+	}
+	else {
+		maxcc_diag_add(c, err_line, err_msg);
+		// the next compile may run on another thread, it clears what this one left
+		text_end = text_p;
+		ret = -1;
+	}
+	err_jmp = 0;
+	err_quiet = 0;
+
+	if (ir)
+		fclose(ir);
+	ir_out = stdout;
+	if (!ret)
+		ret = maxcc_keep(c);
+	pthread_mutex_unlock(&maxcc_lock);
+	return ret;
+}
+
+const int *maxcc_text(maxcc_ctx *c, int *words, int *base) {
+	if (words)
+		*words = c->text_words;
+	if (base)
+		*base = c->text_base;
+	return c->text;
+}
+
+const char *maxcc_rodata(maxcc_ctx *c, int *bytes, int *base) {
+	if (bytes)
+		*bytes = c->rodata_bytes;
+	if (base)
+		*base = c->rodata_base;
+	return c->rodata;
+}
+
+int maxcc_bss(maxcc_ctx *c, int *base) {
+	if (base)
+		*base = c->bss_base;
+	return c->bss_bytes;
+}
+
+int maxcc_entry(maxcc_ctx *c) {
+	return c->entry;
+}
+
+const char *maxcc_ir(maxcc_ctx *c) {
+	return c->ir ? c->ir : "";
+}
+
+int maxcc_diag_count(maxcc_ctx *c) {
+	return c->ndiags;
+}
+
+int maxcc_diag_line(maxcc_ctx *c, int i) {
+	return i >= 0 && i < c->ndiags ? c->diags[i].line : 0;
+}
+
+const char *maxcc_diag_message(maxcc_ctx *c, int i) {
+	return i >= 0 && i < c->ndiags ? c->diags[i].message : "";
+}
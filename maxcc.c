@@ -1,42 +1,93 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "keywords.h"
 
 // Compiler flags
 int dump_ir;
+// where --dump-ir writes, stdout unless the compiler runs as a library
+FILE *ir_out;
+char *time_trace;
+char *profile;
+char *pgo_gen, *pgo_use;
+int keep_frames;
+int whole_program;
+int gen_jobs;
+int lazy_bodies, lazy_pass;
+// Globals, enum constants, functions and struct layouts are numbered as
+// they are declared. A body parse_lazy() parses only sees the ones up to
+// lazy_limit, the number at the place it was skipped.
+int decl_seq, lazy_limit;
+int reg_vm;
+// the selected --targets, a bit per entry of targets[]
+int target_mask;
+char *emit_module;
 
-// Memory layout of a process
+// Memory layout of a process. Code generation state is __thread: every
+// codegen thread of gen_funcs() emits into its own buffer.
 int *stack, *stack_p;
-char *data, *data_p;
-int *old_text, *text, *text_p;
+// The data sections: .rodata holds the string literals, .bss the globals,
+// which are all zero, so the outputs only record its size and alignment.
+char *rodata, *rodata_p;
+char *bss, *bss_p;
+int bss_align;
+// the end of the .bss of the modules the unit links
+char *mod_bss_end;
+int *old_text, *text;
+__thread int *text_p, *text_limit;
+// where the text of the last unit ended, whichever thread compiled it
+int *text_end;
 
 // Registers and cycle of a CPU
 int *pc, *bp, *sp, ax, cycle;
-int idx_of_bp;
+__thread int idx_of_bp;
 
 // Necessary variables to parse source code
 int pool_size;
 char *src;
-int line;
-int token;
-int token_num;
-int *type_size;
+// the lexer state is __thread so that lex() can run on chunks of src
+__thread int line;
+__thread int token;
+__thread int token_num;
+int *type_size, *type_align;
 int type_new;
+int type_builtin;
 int expr_type;
 
-int *case_addr, *default_addr, *break_addr, *continue_addr;
-int switch_cnt;
-int break_cnt;
-int continue_cnt;
+__thread int *case_addr, *case_val, *case_node, *default_addr, *break_addr, *continue_addr;
+// the jump tables of whichever thread compiles a unit, codegen threads have their own
+int *tu_jumps;
+__thread int switch_cnt;
+__thread int break_cnt;
+__thread int continue_cnt;
+int loop_depth, switch_depth;
 
-char *p, *last_p;
-int *ast_ptr;
+__thread char *p;
+char *last_p;
+int *ast, *ast_ptr;
+int expr_depth;
 int local_var_offset;
-int local_var_depth;
+__thread int local_var_depth;
+__thread int frame_max;
+int *ast_top;
+// what the function being compiled does with its frame
+__thread int func_calls, frame_escape, elide, sp_depth;
 
 // Supported tokens and classes
 enum {
@@ -52,55 +103,66 @@ enum {
 };
 
 
-// Supported instructions (opcodes)
+// Supported instructions (opcodes). IMMD is an IMM of an address in
+// .rodata or .bss, which the target backends relocate. VEC names the loop
+// after it for the RISC-V vectorizer and does nothing anywhere else.
 enum {
-	LEA,
-	/* 0 */
+	LEA, LEAS,
+	/* 0 1 */
 	
-	IMM,
-	/* 1 */
+	IMM, IMMD,
+	/* 2 3 */
 
 	JMP,
-	/* 2 */
+	/* 4 */
 
 	CALL,
-	/* 3 */
+	/* 5 */
 
 	BZ, BNZ,
-	/* 4 5 */
+	/* 6 7 */
 
-	ENT,
-	/* 6 */
+	ENT, TAIL, VEC,
+	/* 8 9 10 */
 
 	ADJ,
-	/* 7 */
+	/* 11 */
 
-	LEV,
-	/* 8 */
+	LEV, RET,
+	/* 12 13 */
 
 	LW, LC, SW, SC,
-	/* 9 10 11 12 */
+	/* 14 15 16 17 */
 
 	PUSH,
-	/* 13 */
+	/* 18 */
 
 	OR, XOR, AND,
-	/* 14 15 16 */
+	/* 19 20 21 */
 
 	EQ, NEQ,
-	/* 17 18 */
+	/* 22 23 */
 
 	LT, GT, LE, GE,
-	/* 19 20 21 22 */
+	/* 24 25 26 27 */
 
 	SHL, SHR,
-	/* 23 24 */
+	/* 28 29 */
 
 	ADD, SUB, MUL, DIV, MOD,
-	/* 25 26 27 28 29 */
+	/* 30 31 32 33 34 */
 
 	OPEN, READ, CLOS, PRTF, FPRT, MALC, MSET, MCMP, EXIT
-	/* 30 31 32 33 34 35 36 37 38 */
+	/* 35 36 37 38 39 40 41 42 43 */
+};
+
+// The register form of the instructions for --reg-vm, [op][d][a][b] with
+// the operands naming slots relative to bp
+enum {
+	RLI, RMOV, RLEA, RLW, RLC, RSW, RSC,
+	RJMP, RBZ, RBNZ, RARG, RCALL, RSYS, RADJ, RENT, RLEV, RRET, RAX, RHALT,
+	ROR, RXOR, RAND, REQ, RNEQ, RLT, RGT, RLE, RGE, RSHL, RSHR, RADD, RSUB, RMUL, RDIV, RMOD,
+	RORI, RXORI, RANDI, REQI, RNEQI, RLTI, RGTI, RLEI, RGEI, RSHLI, RSHRI, RADDI, RSUBI, RMULI, RDIVI, RMODI
 };
 
 enum {CHAR, INT, PTR = 256, PTR2 = 512};
@@ -116,29 +178,260 @@ struct ident {
 	int htype;
 	int hval;
 	int struct_type;
-} *id, *sym;
+	int *fixup;
+	int *inline_tree;
+	// [params][frame][body] of a pure function
+	int *pure;
+	struct func_ir *ir;
+	int live;
+	// where the definition of a function with a skipped body starts
+	char *lazy;
+	int lazy_line;
+	int lazy_seq;
+	int used;
+	// the number of its first global declaration, 0 for a module's
+	int seq;
+} *id, *sym, *sym_user, *id_main;
+__thread struct ident *cur_func;
+
+/*
+ * A parsed function waiting for code generation. Without --whole-program
+ * it is emitted as soon as its body is parsed; with it every function of
+ * every file is kept until the whole call graph is known. konst[] holds
+ * the value each of the first WP_PARAMS parameters is passed at every
+ * call site: kstate[] is 0 before a call is seen, 1 while all calls agree
+ * on konst[] and 2 once the parameter varies.
+ */
+#define WP_PARAMS 8
+struct func_ir {
+	struct ident *id;
+	int *body;
+	int params;
+	int frame;
+	int calls;
+	int escape;
+	int konst[WP_PARAMS];
+	int kstate[WP_PARAMS];
+	int walked;
+	// where a codegen thread emitted it, and its CALL and JMP operands
+	// that name functions as [offset][ident] pairs
+	int *code;
+	int size;
+	int *reloc;
+	int nreloc;
+} *funcs;
+__thread struct func_ir *cur_ir;
+int func_cnt;
+int tu_index;
 
 struct struct_member {
 	struct ident *id;
 	int offset;
 	int type;
-	struct struct_member *next;
-} **members;
+};
+
+/*
+ * The layout of a struct or union type: its members in declaration order
+ * and an open addressing index from the hash of a member name to its
+ * position in member[], so a member is found in constant time.
+ */
+struct struct_layout {
+	struct struct_member *member;
+	int count;
+	int *index;
+	int index_mask;
+	// the file that defined it, -1 when it came from a module
+	int tu;
+	int seq;
+} *layouts;
+
+// Where err_exit() returns to when the compiler is driven in-process
+jmp_buf *err_jmp;
+// the last error, err_quiet keeps it off stderr
+int err_line, err_quiet;
+char err_msg[256];
+// A codegen thread can't unwind into the thread that started it: it keeps
+// the first error for gen_funcs() to report after the join and ends itself
+__thread jmp_buf *gen_jmp;
+int gen_err_line;
+char gen_err[256];
+pthread_mutex_t gen_err_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void trace_write();
 
 void err_exit(char *errstr) {
-	fprintf(stderr, "%d: %s", line, errstr);
+	if (gen_jmp) {
+		pthread_mutex_lock(&gen_err_lock);
+		if (!*gen_err) {
+			gen_err_line = line;
+			snprintf(gen_err, sizeof(gen_err), "%s", errstr);
+		}
+		pthread_mutex_unlock(&gen_err_lock);
+		longjmp(*gen_jmp, 1);
+	}
+	err_line = line;
+	snprintf(err_msg, sizeof(err_msg), "%s", errstr);
+	if (!err_quiet)
+		fprintf(stderr, "%d: %s", line, errstr);
+	// a failed compile keeps its trace, the events still open have no duration
+	if (time_trace)
+		trace_write();
+	if (err_jmp)
+		longjmp(*err_jmp, 1);
 	exit(1);
 }
 
+/*
+ * A --time-trace event: a named span of compile time with a detail string
+ * (the source file, the line of a declaration or a function name). The
+ * times are in microseconds since the trace started.
+ */
+struct trace_event {
+	char *name;
+	char detail[64];
+	long long begin;
+	long long end;
+	int tid;
+} *trace_events;
+int trace_cnt, trace_max;
+// codegen threads record events too, numbered from 1
+__thread int trace_tid;
+pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+struct timespec trace_epoch;
+
+long long trace_now() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - trace_epoch.tv_sec) * 1000000LL + (t.tv_nsec - trace_epoch.tv_nsec) / 1000;
+}
+
+/*
+ * trace_begin() - open an event, detail is len bytes or a C string for -1
+ *
+ * Returns the event to pass to trace_end(), or -1 when no trace is taken.
+ */
+int trace_begin(char *name, char *detail, int len) {
+	struct trace_event *e;
+	int ev, n;
+
+	if (!time_trace)
+		return -1;
+	pthread_mutex_lock(&trace_lock);
+	if (trace_cnt == trace_max) {
+		n = trace_max ? trace_max * 2 : 1024;
+		if (!(e = realloc(trace_events, n * sizeof(struct trace_event)))) {
+			pthread_mutex_unlock(&trace_lock);
+			err_exit("error - couldn't malloc for the time trace\n");
+		}
+		trace_events = e;
+		trace_max = n;
+	}
+	if (!detail)
+		len = 0;
+	else if (len < 0)
+		len = strlen(detail);
+	if (len > sizeof(trace_events->detail) - 1)
+		len = sizeof(trace_events->detail) - 1;
+	trace_events[trace_cnt].name = name;
+	if (len)
+		memcpy(trace_events[trace_cnt].detail, detail, len);
+	trace_events[trace_cnt].detail[len] = 0;
+	trace_events[trace_cnt].begin = trace_events[trace_cnt].end = trace_now();
+	trace_events[trace_cnt].tid = trace_tid;
+	ev = trace_cnt++;
+	pthread_mutex_unlock(&trace_lock);
+	return ev;
+}
+
+void trace_end(int ev) {
+	if (ev < 0)
+		return;
+	pthread_mutex_lock(&trace_lock);
+	trace_events[ev].end = trace_now();
+	pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * trace_write() - write the events as Chrome trace-event JSON
+ *
+ * Every event is a complete ("X") event, chrome://tracing and Perfetto
+ * nest them by time.
+ */
+void trace_write() {
+	FILE *f;
+	char *c;
+	int i;
+
+	if (!(f = fopen(time_trace, "w"))) {
+		fprintf(stderr, "error - couldn't write the time trace %s\n", time_trace);
+		return;
+	}
+	fprintf(f, "{\"traceEvents\": [\n");
+	for (i = 0; i < trace_cnt; i++) {
+		fprintf(f, "{\"name\": \"%s\", \"cat\": \"maxcc\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+			"\"ts\": %lld, \"dur\": %lld, \"args\": {\"detail\": \"", trace_events[i].name,
+			(int) getpid(), trace_events[i].tid, trace_events[i].begin, trace_events[i].end - trace_events[i].begin);
+		for (c = trace_events[i].detail; *c; c++) {
+			if (*c == '"' || *c == '\\')
+				fputc('\\', f);
+			if ((unsigned char) *c >= ' ')
+				fputc(*c, f);
+		}
+		fprintf(f, "\"}}%s\n", i < trace_cnt - 1 ? "," : "");
+	}
+	fprintf(f, "], \"displayTimeUnit\": \"ms\"}\n");
+	fclose(f);
+}
+
+/*
+ * lookup_ident() - find or enter the identifier of len bytes at name in
+ * sym, and set id and token to it
+ */
+void lookup_ident(char *name, int len, int hash) {
+	int i;
+
+	// keywords and builtins are found through the generated perfect hash
+	i = kw_slot[(unsigned) hash * KW_MULT >> (32 - KW_BITS)];
+	if (i-- && hash == kw_hash[i] && !memcmp(kw_name[i], name, len)) {
+		id = sym + i;
+		token = id->token;
+		return;
+	}
+
+	for (id = sym_user; id->token; id++) {
+		if (hash == id->hash && !memcmp(id->name, name, len)) {
+			token = id->token;
+			return;
+		}
+	}
+	// keep a zeroed entry behind the last one to end the scan
+	if ((char *) (id + 2) > (char *) sym + pool_size)
+		err_exit("error - too many identifiers\n");
+	id->name = name;
+	id->hash = hash;
+	token = id->token = Id;
+}
+
+// set on the threads of tokenize(), see lex()
+__thread int lex_only;
+// where the last token lex() returned begins
+__thread char *lex_begin;
+
 /* 
- * next() - parse the source code and get the token type;
+ * lex() - parse the source code and get the token type;
+ *
+ * With lex_only nothing outside the lexer state is touched: an identifier
+ * is an Id token with its hash in token_num, a string is a '"' token with
+ * the offset of its opening quote in token_num, and an unterminated
+ * literal is a -1 token at that offset.
  */
-void next() {
+void lex() {
 	int hash;
 	char *id_parser;
 	char *str;
 	while (token = *p) {
-		++p;
+		lex_begin = p++;
 		if ((token >= 'A' && token <= 'Z') || (token >= 'a' && token <= 'z') || (token == '_')) {
 			// parse identifiers
 			id_parser = p - 1;
@@ -150,15 +443,12 @@ void next() {
 				token = *p;
 			}
 			hash = (hash << 6) + (p - id_parser);
-			for (id = sym; id->token; id++) {
-				if (hash == id->hash && !memcmp(id->name, id_parser, p - id_parser)) {
-					token = id->token;
-					return;
-				}
+			if (lex_only) {
+				token = Id;
+				token_num = hash;
+				return;
 			}
-			id->name = id_parser;
-			id->hash = hash;
-			token = id->token = Id;
+			lookup_ident(id_parser, p - id_parser, hash);
 			return;
 		}
 		else if (token >= '0' && token <= '9') {
@@ -169,7 +459,7 @@ void next() {
 			if (token_num > 0) {
 				token = *p;
 				while (token >= '0' && token <= '9') {
-					token_num = token * 10 + token - '0';
+					token_num = token_num * 10 + token - '0';
 					++p;
 					token = *p;
 				}
@@ -189,7 +479,7 @@ void next() {
 					++p;
 					token = *p;
 					while ((token >= '0' && token <= '9') || (token >= 'a' && token <= 'f') || (token >= 'A' && token <= 'F')) {
-						token_num = token_num * 16 + token - '0';
+						token_num = token_num * 16 + (token <= '9' ? token - '0' : (token | 0x20) - 'a' + 10);
 						++p;
 						token = *p;
 					}
@@ -208,10 +498,11 @@ void next() {
 		}
 		else if (token == '"' || token == '\'') {
 			// parse a character or string
-			str = data_p;
+			str = rodata_p;
+			id_parser = p - 1;
 			while(*p != 0 && *p != token) {
 				token_num = *p++;
-				if (token_num == '\\') {
+				if (token_num == '\\' && *p) {
 					token_num = *p++;
 					switch(token_num) {
 					case 'n':
@@ -225,14 +516,24 @@ void next() {
 						break;
 					}
 				}
-				if (token == '"') {
-					*data_p++ = token_num;
+				if (token == '"' && !lex_only) {
+					if (rodata_p >= rodata + pool_size - sizeof(int))
+						err_exit("error - rodata section overflow\n");
+					*rodata_p++ = token_num;
 				}
 			}
+			if (!*p) {
+				if (lex_only) {
+					token = -1;
+					token_num = id_parser - src;
+					return;
+				}
+				err_exit("error - unterminated string or character literal\n");
+			}
 			p++;
 
 			if (token == '"') {
-				token_num = (int) str;
+				token_num = lex_only ? id_parser - src : (int) str;
 			}
 			else {
 				token = Num;
@@ -242,8 +543,8 @@ void next() {
 		switch (token) {
 		case '\n':
 			// ignore newline character
-			if (dump_ir) {
-				printf("%d: %.*s", line, p - last_p, last_p);
+			if (dump_ir && !lex_only) {
+				fprintf(ir_out, "%d: %.*s", line, p - last_p, last_p);
 				last_p = p;
 			}
 			++line;
@@ -277,6 +578,10 @@ void next() {
 				p++;
 				token = Dec;
 			}
+			else if (*p == '>') {
+				p++;
+				token = Arrow;
+			}
 			else {
 				token = Sub;
 			}
@@ -285,19 +590,21 @@ void next() {
 			token = Mul;
 			return;
 		case '/':
-			token = *p;
-			++p;
-			if (token == '/') {
+			if (*p == '/') {
+				++p;
 				while (*p && *p != '\n') {
 					++p;
 				}
 			}
-			else if (token == '*') {
-				while (*p && (*(p - 1) != '*' || *p != '/')) {
-					if (*p == '\n');
+			else if (*p == '*') {
+				++p;
+				while (*p && (*p != '*' || p[1] != '/')) {
+					if (*p == '\n')
 						++line;
 					++p;
 				}
+				if (*p)
+					p += 2;
 			}
 			else {
 				token = Div;
@@ -312,6 +619,7 @@ void next() {
 				p++;
 				token = Ne;
 			}
+			return;
 		case '<':
 			if (*p == '=') {
 				p++;
@@ -365,6 +673,9 @@ void next() {
 		case '?':
 			token = Cond;
 			return;
+		case '.':
+			token = Dot;
+			return;
 		case ' ':
 		case '\t':
 		case '\r':
@@ -384,834 +695,6909 @@ void next() {
 	}
 }
 
-void match_token(int expected) {
-	if (token == expected) {
-		next();
-	}
-	else {
-		fprintf(stderr, "%d: expected token: %c\n", line, expected);
-		exit(-1);
-	}
-}
-
-
-void expr(int level) {
-	int old_token;
-	struct ident *d;
-	struct struct_member *sm;
-
-	int params_cnt, *params_b;
-	int name_len;
-	char ch;
-
-	int type, *old_ast_ptr;
-	int size;
-
-	switch(token) {
-	case '\0': 
-		err_exit("error - unexpected EOF in an expression\n");
-	case Num:
-		*--ast_ptr = token_num;
-		*--ast_ptr = Num;
-		next();
-		expr_type = INT;
-		break;
-	case '"':
-		*--ast_ptr = token_num;
-		*--ast_ptr = Num;
-		next();
-		while (token == '"')
-			next();
-		data_p = (char *) (((int) data_p + sizeof(int)) & (-sizeof(int)));
-		expr_type = PTR;
-		break;
-	case Sizeof:
-		next();
-		match_token('(');
-		next();
-		expr_type = INT;
-		switch(token) {
-		case Int: 
-			next();
-			break;
-		case Char:
-			next();
-			expr_type = CHAR;
-			break;
-		case Struct:
-		case Union:
-			next();
-			if (token != Id) 
-				err_exit("error - expected identifier");
-			expr_type = id->struct_type;
-			next();
-			break;
-		}
-		while (token == Mul) {
-			next();
-			expr_type += PTR;
-		}
-		match_token(')');
-		next();
-		*--ast_ptr = expr_type >= PTR ? sizeof(int) : type_size[expr_type];
-		*--ast_ptr = Num;
-		expr_type = INT;
-		break;
-	case Id:
-		d = id;
-		next();
+/*
+ * The token buffer of a file lexed ahead by tokenize(), as arrays of the
+ * kind, value, first and past-the-end source offsets and line of every
+ * token. It ends with a 0 token at the end of src.
+ */
+int *tok_kind, *tok_val, *tok_begin, *tok_end, *tok_line;
+int tok_cnt, tok_next;
+char *tok_p;
 
-		if (token == '(') {
-			if (d->class < Func || d->class > Main) {
-				if (d->class != 0)
-					err_exit("error - bad function call\n");
-				name_len = d->hash & 0x3f;
-				ch = d->name[name_len];
-				d->name[name_len] = 0;
-				d->val = 0; // should be function address
-				d->name[name_len] = ch;
-				d->class = Syscall;
-				d->type = INT;
-			}
-			next();
-			params_cnt = 0;
-			params_b = 0;
-			while (token != ')') {
-				expr(Assign);
-				*--ast_ptr = (int) params_b;
-				params_b = ast_ptr;
-				++params_cnt;
-				if (token == ',') {
-					next();
-					if (token == ')')
-						err_exit("error - unexpected comma in function call\n");
-				}
-				else if (token != ')') {
-					err_exit("error - missing comma in function call\n");
+struct lex_chunk {
+	char *from, *to;
+	int line;
+	int *kind, *val, *begin, *end, *lines;
+	int cnt;
+	int end_line;
+};
 
-				}
-			}
-			next();
-			*--ast_ptr = params_cnt;
-			*--ast_ptr = d->val;
-			*--ast_ptr = (int) params_b;
-			*--ast_ptr = d->class;
-			expr_type = d->type;
-		}
-		else if (d->class == Num) {
-			*--ast_ptr = d->val;
-			*--ast_ptr = Num;
-			expr_type = INT;
-		}
-		else {
-			switch(d->class) {
-			case Local:
-				*--ast_ptr = d->val;
-				*--ast_ptr = Local;
-				break;
-			case Global:
-				*--ast_ptr = d->val;
-				*--ast_ptr = Num;
-				break;
-			default:
-				err_exit("error - undefined variable\n");			
-			}
-			*--ast_ptr = expr_type = d->type;
-			*--ast_ptr = Load;
-		}
-		break;
-	case '(':
-	case Mul:
-	case And:
-	case '!':
-	case '~':
-	case Add:
-	case Sub:
-	case Div:
-	case Mod:
-		break;
-	case Inc:
-	case Dec:
-		break;
-	default:
-		err_exit("error - bad expression\n");
-	}
+/*
+ * lex_split() - cut the len bytes of src into at most n chunks
+ *
+ * A chunk starts at the beginning of a line that is outside comments and
+ * literals, so every token lies within one chunk. lines[] gets the line
+ * each chunk starts at, counted the way lex() counts them.
+ */
+int lex_split(int len, int n, char **from, int *lines) {
+	char *s, *cut;
+	int c, k, ln;
 
-	while (token >= level) {
-		type = expr_type;
-		old_ast_ptr = ast_ptr;
-		switch(token) {
-		case Assign:
-			next();
-			if (*ast_ptr != Load)
-				err_exit("error - bad lvalue in assignment");
-			expr(Assign);
-			*--ast_ptr = (int) (old_ast_ptr + 2);
-			*--ast_ptr = expr_type = type;
-			*--ast_ptr = Assign;
-			break;
-		case Cond:
-		case Lor:
-		case Lan:
-		case Or:
-		case Xor:
-		case And:
-		case Eq:
-		case Ne:
-		case Lt:
-		case Gt:
-		case Le:
-		case Ge:
-		case Shl:
-		case Shr:
-			break;
-		case Add:
-			next();
-			expr(Mul);
-			size = (expr_type = type) >= PTR2 ? sizeof(int) :
-							expr_type >= PTR ? type_size[expr_type - PTR] : 1;
-			if (*ast_ptr == Num)
-				ast_ptr[1] = ast_ptr[1] * size;
-			if (*ast_ptr == Num && *old_ast_ptr == Num)
-				ast_ptr[1] = ast_ptr[1] + old_ast_ptr[1];
-			else {
-				*--ast_ptr = (int) old_ast_ptr;
-				*--ast_ptr = Add;
+	s = src;
+	ln = 1;
+	k = 0;
+	from[k] = s;
+	lines[k++] = ln;
+	cut = src + len / n;
+	while ((c = *s++)) {
+		switch (c) {
+		case '\n':
+			++ln;
+			if (s >= cut && k < n) {
+				from[k] = s;
+				lines[k++] = ln;
+				cut = s + len / n;
 			}
 			break;
-		case Sub:
-			next();
-			expr(Mul);
-			size = type >= PTR2 ? sizeof(int) : type >= PTR ? type_size[type = PTR] : 1;
-			if (size > 1 && *ast_ptr == Num) {
-				*--ast_ptr = size;
-				*--ast_ptr = Num;
-				--ast_ptr;
-				*ast_ptr = (int) (ast_ptr + 3);
-				*--ast_ptr = Mul;
-			}
-			if (*ast_ptr == Num && *old_ast_ptr == Num)
-				ast_ptr[1] = old_ast_ptr[1] - ast_ptr[1];
-			else {
-				*--ast_ptr = (int) old_ast_ptr;
-				*--ast_ptr = Sub;
-				if (type == expr_type && size > 1) {
-					switch(size) {
-					case 4:
-						*--ast_ptr = 2;
-						*--ast_ptr = Num;
-						--ast_ptr;
-						*ast_ptr = (int) (ast_ptr + 3);
-						*--ast_ptr = Shr;
-						break;
-					default:
-						*--ast_ptr = size;
-						*--ast_ptr = Num;
-						--ast_ptr;
-						*ast_ptr = (int) (ast_ptr + 3);
-						*--ast_ptr = Sub;
-					}
-				}
+		case '"':
+		case '\'':
+			while (*s && *s != c) {
+				if (*s == '\\' && s[1])
+					++s;
+				++s;
 			}
+			if (*s)
+				++s;
 			break;
-		case Mul:
-			next();
-			expr(Inc);
-			if (*ast_ptr == Num && *old_ast_ptr == Num) {
-				ast_ptr[1] = ast_ptr[1] * old_ast_ptr[1];
-			}
-			else {
-				*--ast_ptr = (int) old_ast_ptr;
-				/*
-				if (ast_ptr[1] == Num && ast_ptr[2] > 0 && (ast_ptr[2] & (ast_ptr[2] - 1)) == 0) {
-					ast_ptr[2]; // popcount;
+		case '/':
+			if (*s == '/' || *s == '*') {
+				c = *s++;
+				while (*s && (c == '/' ? *s != '\n' : *s != '*' || s[1] != '/')) {
+					if (*s == '\n')
+						++ln;
+					++s;
 				}
-				else
-				*/
-					*--ast_ptr = Mul;
+				if (c == '*' && *s)
+					s += 2;
 			}
-			expr_type = INT;
-			break;
-		case Inc:
-		case Dec:
 			break;
-		case Div:
-		case Mod:
-		case Dot:
-		case Arrow:
-		case Bracket:
-		default:
+		case '#':
+			while (*s && *s != '\n')
+				++s;
 			break;
 		}
 	}
+	return k;
 }
 
-/* 
- * stmt() - parse statements in any blocks
- * 
- * 
- * 
+/*
+ * lex_thread() - lex the tokens that start in one chunk
  */
-void stmt(int target) {
-	int type;
+void *lex_thread(void *arg) {
+	struct lex_chunk *c;
+	int n;
 
-	switch (target) {
-	case Func:
-		local_var_depth = idx_of_bp;
-		match_token('{');
-		// parse local variables and other statements.
-		while (token == Int || token == Char || token == Struct || token == Union) {
-			type = INT;
-			while (token != ';') {
-	
-				switch(token) {
-					case Int:
-						next();
-						break;
-					case Char:
-						type = CHAR;
-						next();
-						break;
-					case Struct:
-					case Union:
-						next();
-						if (token != Id) 
-							err_exit("error - bad struct/union declaration\n");
-						type = id->struct_type;
-						next();
-						break;
-				}
-	
-				if (token != Id) 
-					err_exit("error - expected identifier\n");
-				next();
+	c = arg;
+	lex_only = 1;
+	p = c->from;
+	line = c->line;
+	n = c->to - c->from + 1;
+	c->kind = malloc(n * sizeof(int));
+	c->val = malloc(n * sizeof(int));
+	c->begin = malloc(n * sizeof(int));
+	c->end = malloc(n * sizeof(int));
+	c->lines = malloc(n * sizeof(int));
+	c->cnt = 0;
+	if (!c->kind || !c->val || !c->begin || !c->end || !c->lines)
+		return c;
+	while (1) {
+		lex();
+		if (!token || p > c->to)
+			break;
+		c->kind[c->cnt] = token;
+		c->val[c->cnt] = token_num;
+		c->begin[c->cnt] = lex_begin - src;
+		c->end[c->cnt] = p - src;
+		c->lines[c->cnt++] = line;
+	}
+	c->end_line = line;
+	return c;
+}
 
-				id->hclass = id->class;
-				id->class = Local;
-				
-				id->htype = id->type;
-				id->type = type;
+/*
+ * tok_free() - drop the token buffer, lex() reads src again
+ */
+void tok_free() {
+	free(tok_kind);
+	free(tok_val);
+	free(tok_begin);
+	free(tok_end);
+	free(tok_line);
+	tok_kind = tok_val = tok_begin = tok_end = tok_line = 0;
+	tok_cnt = 0;
+}
 
-				id->hval = id->val;
-				id->val = ++local_var_depth;
+/*
+ * tokenize() - lex the len bytes of src on n threads into the token buffer
+ *
+ * The chunks of lex_split() are lexed in parallel and their tokens are
+ * appended in source order. Identifiers are only hashed and strings only
+ * found, they are entered in sym and .rodata as the parser reaches them.
+ */
+void tokenize(int len, int n) {
+	struct lex_chunk *c;
+	pthread_t *threads;
+	char **from;
+	int *lines, i, k, ev;
 
-				if (token == ',')
-					next();
-	
+	ev = trace_begin("tokenize", 0, 0);
+	c = calloc(n, sizeof(struct lex_chunk));
+	threads = malloc(n * sizeof(pthread_t));
+	from = malloc(n * sizeof(char *));
+	lines = malloc(n * sizeof(int));
+	if (!c || !threads || !from || !lines)
+		err_exit("error - couldn't malloc for the lexer threads\n");
+	n = lex_split(len, n, from, lines);
+	for (i = 0; i < n; i++) {
+		c[i].from = from[i];
+		c[i].to = i < n - 1 ? from[i + 1] : src + len;
+		c[i].line = lines[i];
+		if (pthread_create(&threads[i], 0, lex_thread, &c[i]))
+			err_exit("error - couldn't start a lexer thread\n");
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(threads[i], 0);
+
+	tok_cnt = 1;
+	for (i = 0; i < n; i++) {
+		if (!c[i].lines)
+			err_exit("error - couldn't malloc for the token buffer\n");
+		tok_cnt += c[i].cnt;
+	}
+	tok_kind = malloc(tok_cnt * sizeof(int));
+	tok_val = malloc(tok_cnt * sizeof(int));
+	tok_begin = malloc(tok_cnt * sizeof(int));
+	tok_end = malloc(tok_cnt * sizeof(int));
+	tok_line = malloc(tok_cnt * sizeof(int));
+	if (!tok_kind || !tok_val || !tok_begin || !tok_end || !tok_line)
+		err_exit("error - couldn't malloc for the token buffer\n");
+	for (i = k = 0; i < n; k += c[i++].cnt) {
+		memcpy(tok_kind + k, c[i].kind, c[i].cnt * sizeof(int));
+		memcpy(tok_val + k, c[i].val, c[i].cnt * sizeof(int));
+		memcpy(tok_begin + k, c[i].begin, c[i].cnt * sizeof(int));
+		memcpy(tok_end + k, c[i].end, c[i].cnt * sizeof(int));
+		memcpy(tok_line + k, c[i].lines, c[i].cnt * sizeof(int));
+		free(c[i].kind);
+		free(c[i].val);
+		free(c[i].begin);
+		free(c[i].end);
+		free(c[i].lines);
+	}
+	tok_kind[k] = 0;
+	tok_val[k] = 0;
+	tok_begin[k] = tok_end[k] = len;
+	tok_line[k] = c[n - 1].end_line;
+	tok_next = 0;
+	tok_p = src;
+
+	free(c);
+	free(threads);
+	free(from);
+	free(lines);
+	trace_end(ev);
+}
+
+/*
+ * echo_lines() - print the source lines before to for --dump-ir, the way
+ * lex() prints them: a line that ends in a block comment goes out with
+ * the line the comment ends on
+ */
+void echo_lines(char *to) {
+	char *c;
+	int n, k, comment;
+
+	for (n = 0, c = last_p; c < to; c++)
+		n += *c == '\n';
+	comment = 0;
+	for (k = 0, c = last_p; c < to; c++) {
+		if (comment ? *c == '*' && c[1] == '/' : *c == '/' && c[1] == '*') {
+			comment = !comment;
+			++c;
+		}
+		else if (!comment && (*c == '#' || (*c == '/' && c[1] == '/'))) {
+			while (c[1] != '\n' && c + 1 < to)
+				++c;
+		}
+		else if (*c == '\n') {
+			if (!comment) {
+				fprintf(ir_out, "%d: %.*s", line - n + k, c + 1 - last_p, last_p);
+				last_p = c + 1;
 			}
-			next();
+			++k;
 		}
+	}
+}
 
-		*++text_p = ENT;
-		*++text_p = local_var_depth - idx_of_bp;
+/*
+ * next() - move to the next token, from the token buffer when there is one
+ *
+ * When p was moved away from the last token, by skip_body() or
+ * parse_lazy(), the buffer continues at the first token after p.
+ */
+void next() {
+	int i, lo, hi;
 
-		while (token != '}') {
-			stmt(token);
+	if (!tok_kind) {
+		lex();
+		return;
+	}
+	if (p != tok_p) {
+		lo = 0;
+		hi = tok_cnt - 1;
+		while (lo < hi) {
+			i = (lo + hi) / 2;
+			if (tok_begin[i] < p - src)
+				lo = i + 1;
+			else
+				hi = i;
 		}
+		tok_next = lo;
+	}
+	i = tok_next;
+	if (tok_kind[i])
+		++tok_next;
+	token = tok_kind[i];
+	token_num = tok_val[i];
+	line = tok_line[i];
+	p = tok_p = src + tok_end[i];
+	if (dump_ir)
+		echo_lines(src + tok_begin[i]);
+	if (token == Id)
+		lookup_ident(src + tok_begin[i], tok_end[i] - tok_begin[i], token_num);
+	else if (token == '"' || token == -1) {
+		// strings go to .rodata in source order, errors are reported by lex()
+		p = src + token_num;
+		lex();
+		tok_p = p;
+	}
+}
 
-		*++text_p = LEV;
-		break;
-	case If:
-	case While:
+void match_token(int expected) {
+	char errstr[32];
+
+	if (token == expected) {
 		next();
-		match_token('(');
-		// parse condition
-		match_token(')');
-		if (token == '{') {
-			next();
-			while (token != '}') {
-				stmt(token);
-			}
+	}
+	else {
+		sprintf(errstr, "expected token: %c\n", expected);
+		err_exit(errstr);
+	}
+}
+
+
+/*
+ * type_sizeof() - the size of a value of the given type
+ */
+/*
+ * decl_seen() - whether the code being parsed can see declaration seq
+ */
+int decl_seen(int seq) {
+	return !lazy_pass || seq <= lazy_limit;
+}
+
+int type_sizeof(int type) {
+	if (type < PTR && type >= type_builtin && !decl_seen(layouts[type].seq))
+		return 0;
+	return type >= PTR ? sizeof(int) : type_size[type];
+}
+
+/*
+ * type_alignof() - the alignment of a value of the given type
+ */
+int type_alignof(int type) {
+	if (type < PTR && type >= type_builtin && !decl_seen(layouts[type].seq))
+		return 0;
+	return type >= PTR ? sizeof(int) : type_align[type];
+}
+
+/*
+ * struct_tag() - the type named by the struct/union tag in the current token
+ *
+ * A tag seen for the first time gets a new, still incomplete, type so
+ * pointers to it can be declared before its definition.
+ */
+int struct_tag() {
+	int type;
+
+	if (token != Id)
+		err_exit("error - expected struct/union tag\n");
+	if (!id->struct_type) {
+		if (type_new >= PTR)
+			err_exit("error - too many struct/union types\n");
+		id->struct_type = type_new++;
+	}
+	type = id->struct_type;
+	next();
+	return type;
+}
+
+/*
+ * struct_member() - find a member of a struct or union type by name
+ */
+struct struct_member *struct_member(int type, struct ident *name) {
+	struct struct_layout *l;
+	int i;
+
+	l = &layouts[type];
+	if (!l->index || !decl_seen(l->seq))
+		return 0;
+	for (i = name->hash & l->index_mask; l->index[i] >= 0; i = (i + 1) & l->index_mask) {
+		if (l->member[l->index[i]].id == name)
+			return &l->member[l->index[i]];
+	}
+	return 0;
+}
+
+// How the nodes of the operators in op_table are built
+enum {OP_ASSIGN, OP_COND, OP_BINARY, OP_ADD, OP_SUB, OP_POSTFIX, OP_MEMBER, OP_INDEX};
+
+/*
+ * op_table - binary, postfix and member access operators, indexed by token - Assign
+ *
+ * The operator tokens are declared in order of increasing precedence, so
+ * expr() keeps extending its operand while token >= level. rhs is the level
+ * the right operand is parsed at: the operator's own token makes it right
+ * associative, the token after its precedence group makes it left
+ * associative.
+ */
+struct op_info {
+	int rhs;
+	int kind;
+} op_table[] = {
+	{Assign, OP_ASSIGN},	// Assign
+	{Cond, OP_COND},	// Cond
+	{Lan, OP_BINARY},	// Lor
+	{Or, OP_BINARY},	// Lan
+	{Xor, OP_BINARY},	// Or
+	{And, OP_BINARY},	// Xor
+	{Eq, OP_BINARY},	// And
+	{Lt, OP_BINARY},	// Eq
+	{Lt, OP_BINARY},	// Ne
+	{Shl, OP_BINARY},	// Lt
+	{Shl, OP_BINARY},	// Gt
+	{Shl, OP_BINARY},	// Le
+	{Shl, OP_BINARY},	// Ge
+	{Add, OP_BINARY},	// Shl
+	{Add, OP_BINARY},	// Shr
+	{Mul, OP_ADD},		// Add
+	{Mul, OP_SUB},		// Sub
+	{Inc, OP_BINARY},	// Mul
+	{Inc, OP_BINARY},	// Div
+	{Inc, OP_BINARY},	// Mod
+	{0, OP_POSTFIX},	// Inc
+	{0, OP_POSTFIX},	// Dec
+	{0, OP_MEMBER},		// Dot
+	{0, OP_MEMBER},		// Arrow
+	{Assign, OP_INDEX}	// Bracket
+};
+
+/*
+ * node_folds() - whether a op b can be computed here, which the divisions
+ * that trap and the shifts C leaves undefined can't
+ */
+int node_folds(int op, int a, int b) {
+	if (op == Div || op == Mod)
+		return b && !(b == -1 && a == INT_MIN);
+	if (op == Shl || op == Shr)
+		return b >= 0 && b <= 31;
+	return 1;
+}
+
+/*
+ * node_binary() - build a binary node from left and the subtree at ast_ptr
+ *
+ * A binary node is [op][left] followed by its right operand. Two constant
+ * operands are folded into the left Num node and the right one is dropped.
+ */
+void node_binary(int op, int *left) {
+	int a, b;
+
+	// a [Global][ident][offset] address absorbs constant offsets
+	if (*left == Global && *ast_ptr == Num && (op == Add || op == Sub)) {
+		left[2] += op == Add ? ast_ptr[1] : -ast_ptr[1];
+		ast_ptr = left;
+		return;
+	}
+	if (*ast_ptr == Num && *left == Num && node_folds(op, left[1], ast_ptr[1])) {
+		a = left[1];
+		b = ast_ptr[1];
+		switch (op) {
+		case Lor: a = a || b; break;
+		case Lan: a = a && b; break;
+		case Or:  a = a | b;  break;
+		case Xor: a = a ^ b;  break;
+		case And: a = a & b;  break;
+		case Eq:  a = a == b; break;
+		case Ne:  a = a != b; break;
+		case Lt:  a = a < b;  break;
+		case Gt:  a = a > b;  break;
+		case Le:  a = a <= b; break;
+		case Ge:  a = a >= b; break;
+		case Shl: a = a << b; break;
+		case Shr: a = a >> b; break;
+		case Add: a = a + b;  break;
+		case Sub: a = a - b;  break;
+		case Mul: a = a * b;  break;
+		case Div: a = a / b;  break;
+		case Mod: a = a % b;  break;
 		}
-		else
-			stmt(token);
-		break;
+		left[1] = a;
+		ast_ptr = left;
+		return;
+	}
+	*--ast_ptr = (int) left;
+	*--ast_ptr = op;
+}
+
+/*
+ * node_const() - apply op with a constant right operand to the subtree at ast_ptr
+ */
+void node_const(int op, int val) {
+	int *left;
+
+	left = ast_ptr;
+	*--ast_ptr = val;
+	*--ast_ptr = Num;
+	node_binary(op, left);
+}
+
+/*
+ * Compile-time evaluation. A function is pure when its tree reads no
+ * global by name, makes no syscall and calls nothing but itself and other
+ * pure functions. A call to it whose arguments are all constants is run
+ * while it is parsed and becomes a Num. The tree is walked in a sandbox
+ * with its own stack: a memory access outside that stack, a division that
+ * would trap, a shift out of range, too many steps or too deep a recursion
+ * give up and leave the call for run time.
+ */
+enum {CE_STACK = 16384, CE_STEPS = 1000000, CE_DEPTH = 64};
+int *ce_stack, *ce_sp, *ce_bp;
+int ce_steps, ce_depth, ce_seek, ce_seek_val, ce_ret;
+jmp_buf ce_fail;
+
+/*
+ * ce_pure() - whether a tree of the function being parsed is pure
+ */
+int ce_pure(int *n) {
+	int *a;
+
+	if (!n)
+		return 1;
+	switch (*n) {
+	case Num:
+	case Local:
+	case Case:
+	case Default:
+	case Break:
+	case Continue:
+		return 1;
+	case Global:
+	case Syscall:
+		return 0;
+	case Load:
+	case Inc:
+	case Dec:
+		return ce_pure(n + (*n == Load ? 2 : 3));
+	case Assign:
+		return ce_pure((int *) n[2]) && ce_pure(n + 3);
+	case Cond:
+	case If:
+		return ce_pure((int *) n[1]) && ce_pure((int *) n[2]) && ce_pure(*n == Cond ? n + 3 : (int *) n[3]);
+	case Func:
+		if ((struct ident *) n[2] != cur_func && !((struct ident *) n[2])->pure)
+			return 0;
+		for (a = (int *) n[1]; a; a = (int *) *a) {
+			if (!ce_pure(a + 1))
+				return 0;
+		}
+		return 1;
+	case ';':
+	case Return:
+		return ce_pure((int *) n[1]);
+	case While:
 	case DoWhile:
-		next();
-		match_token('{');
-		// parse statments
-		while (token != '}') {
-			stmt(token);
+	case Switch:
+		return ce_pure((int *) n[1]) && ce_pure((int *) n[2]);
+	case For:
+		return ce_pure((int *) n[1]) && ce_pure((int *) n[2]) && ce_pure((int *) n[3]) && ce_pure((int *) n[4]);
+	default:
+		// '{' and the binary operators
+		return ce_pure((int *) n[1]) && ce_pure(n + 2);
+	}
+}
+
+/*
+ * ce_label() - whether a statement holds a label of the enclosing switch
+ */
+int ce_label(int *n) {
+	if (!n)
+		return 0;
+	switch (*n) {
+	case Case:
+	case Default:
+		return 1;
+	case '{':
+		return ce_label((int *) n[1]) || ce_label(n + 2);
+	case If:
+		return ce_label((int *) n[2]) || ce_label((int *) n[3]);
+	case While:
+	case DoWhile:
+		return ce_label((int *) n[2]);
+	case For:
+		return ce_label((int *) n[4]);
+	}
+	return 0;
+}
+
+/*
+ * ce_addr() - the sandbox address a of an object of size bytes
+ */
+int *ce_addr(int a, int size) {
+	if (a < (int) ce_stack || a + size > (int) (ce_stack + CE_STACK))
+		longjmp(ce_fail, 1);
+	return (int *) a;
+}
+
+int ce_call(struct ident *d, int *args, int cnt);
+
+/*
+ * ce_eval() - the value of an expression tree in the sandbox
+ */
+int ce_eval(int *n) {
+	int a, b, i;
+
+	if (++ce_steps > CE_STEPS)
+		longjmp(ce_fail, 1);
+	switch (*n) {
+	case Num:
+		return n[1];
+	case Local:
+		return (int) (ce_bp + n[1]);
+	case Load:
+		a = ce_eval(n + 2);
+		if (n[1] == CHAR)
+			return *(char *) ce_addr(a, 1);
+		if (n[1] >= PTR || n[1] < type_builtin)
+			return *ce_addr(a, sizeof(int));
+		return a;
+	case Assign:
+		a = ce_eval((int *) n[2]);
+		b = ce_eval(n + 3);
+		if (n[1] == CHAR)
+			return *(char *) ce_addr(a, 1) = b;
+		return *ce_addr(a, sizeof(int)) = b;
+	case Inc:
+	case Dec:
+		i = n[1] >= PTR ? type_sizeof(n[1] - PTR) : 1;
+		if (*n == Dec)
+			i = -i;
+		a = ce_eval(n + 3);
+		if (n[1] == CHAR)
+			b = *(char *) ce_addr(a, 1) = *(char *) ce_addr(a, 1) + i;
+		else
+			b = *ce_addr(a, sizeof(int)) = *ce_addr(a, sizeof(int)) + i;
+		// postfix steps the stored value back, as the code does
+		return n[2] ? b - i : b;
+	case Cond:
+		return ce_eval((int *) n[1]) ? ce_eval((int *) n[2]) : ce_eval(n + 3);
+	case Lor:
+		return ce_eval((int *) n[1]) || ce_eval(n + 2);
+	case Lan:
+		return ce_eval((int *) n[1]) && ce_eval(n + 2);
+	case Func:
+		return ce_call((struct ident *) n[2], (int *) n[1], n[3]);
+	case Global:
+	case Syscall:
+		longjmp(ce_fail, 1);
+	}
+
+	a = ce_eval((int *) n[1]);
+	b = ce_eval(n + 2);
+	switch (*n) {
+	case Or:  return a | b;
+	case Xor: return a ^ b;
+	case And: return a & b;
+	case Eq:  return a == b;
+	case Ne:  return a != b;
+	case Lt:  return a < b;
+	case Gt:  return a > b;
+	case Le:  return a <= b;
+	case Ge:  return a >= b;
+	case Shl:
+	case Shr:
+		if (b < 0 || b > 31)
+			longjmp(ce_fail, 1);
+		return *n == Shl ? a << b : a >> b;
+	case Add: return a + b;
+	case Sub: return a - b;
+	case Mul: return a * b;
+	case Div:
+	case Mod:
+		if (!b || (b == -1 && a == INT_MIN))
+			longjmp(ce_fail, 1);
+		return *n == Div ? a / b : a % b;
+	}
+	longjmp(ce_fail, 1);
+}
+
+/*
+ * ce_stmt() - run a statement tree in the sandbox
+ *
+ * Returns 0 when it completes, else the Break, Continue or Return that
+ * ended it. While ce_seek is set a switch skips to its case label.
+ */
+int ce_stmt(int *n) {
+	int r;
+
+	if (!n)
+		return 0;
+	if (++ce_steps > CE_STEPS)
+		longjmp(ce_fail, 1);
+	if (ce_seek && *n != '{' && *n != Case && *n != Default) {
+		// a label inside another statement is not looked for
+		if (ce_label(n))
+			longjmp(ce_fail, 1);
+		return 0;
+	}
+	switch (*n) {
+	case ';':
+		return ce_stmt((int *) n[1]);
+	case '{':
+		if ((r = ce_stmt((int *) n[1])))
+			return r;
+		return ce_stmt(n + 2);
+	case If:
+		return ce_stmt((int *) (ce_eval((int *) n[1]) ? n[2] : n[3]));
+	case While:
+	case For:
+		// [While][cond][body]  /  [For][init][cond][step][body]
+		if (*n == For)
+			ce_stmt((int *) n[1]);
+		while (*n == For ? !n[2] || ce_eval((int *) n[2]) : ce_eval((int *) n[1])) {
+			r = ce_stmt((int *) n[*n == For ? 4 : 2]);
+			if (r == Break)
+				break;
+			if (r == Return)
+				return r;
+			if (*n == For)
+				ce_stmt((int *) n[3]);
 		}
-		match_token('}');
-		match_token(While);
-		match_token('(');
-		// parse condition
-		match_token(')');	
-		match_token(';');
-		break;
+		return 0;
+	case DoWhile:
+		do {
+			r = ce_stmt((int *) n[2]);
+			if (r == Break)
+				break;
+			if (r == Return)
+				return r;
+		} while (ce_eval((int *) n[1]));
+		return 0;
 	case Switch:
-		next();
-		match_token('(');
-		// parse target variable
-		match_token(')');
-		match_token('{');
-		while (token != '}') {
-			stmt(token);
+		ce_seek_val = ce_eval((int *) n[1]);
+		ce_seek = Case;
+		r = ce_stmt((int *) n[2]);
+		if (ce_seek) {
+			ce_seek = Default;
+			r = ce_stmt((int *) n[2]);
 		}
-		match_token('}');
-		break;
+		ce_seek = 0;
+		return r == Break ? 0 : r;
 	case Case:
-		next();
-		match_token('(');
-		
-		match_token(')');
-		break;
+	case Default:
+		if (ce_seek == *n && (*n == Default || n[1] == ce_seek_val))
+			ce_seek = 0;
+		return 0;
 	case Break:
-		next();
-		match_token(';');
-		break;
 	case Continue:
-		next();
-		match_token(';');
-		break;
-	case Default:
-		next();
-		break;
+		return *n;
 	case Return:
-		next();
-		if (token != ';') {
-			expr(Assign);
-		}
-		match_token(';');
-		break;
-	case For:
-		next();
-		match_token('(');
-		stmt(Assign);
-		match_token(';');
-		stmt(Assign);
-		match_token(';');
-		stmt(Assign);
-		match_token(')');
-		if (token == '{') {
-			next();
-			while (token != '}') {
-				stmt(token);
-			}
-		}
-		else
-			stmt(token);
-		break;
-//	case Goto:
-		break;
+		ce_ret = n[1] ? ce_eval((int *) n[1]) : 0;
+		return Return;
 	default:
-		expr(Assign);
-		next();
-		break;
+		ce_eval(n);
+		return 0;
 	}
 }
 
-/* 
- * parse_global_decl() - parse global variables, functions and composite data types
- * 
- * It should parse the source code matching the following form.
- * 	(...) means function parameters.
- *	{...} means function definition or composite data types definition.
- *
- * 
- * variable:
- * 	<type> [*] <id> [ = (<expr> | {...})] ;
+void ce_args(int *arg) {
+	int v;
+
+	if (!arg)
+		return;
+	ce_args((int *) *arg);
+	v = ce_eval(arg + 1);
+	*--ce_sp = v;
+}
+
+/*
+ * ce_call() - run the pure function d on the arguments, its frame laid out
+ * as the code would lay it out
+ */
+int ce_call(struct ident *d, int *args, int cnt) {
+	int *t, *old_sp, *old_bp;
+
+	t = d->pure;
+	if (!t || cnt != t[0] - 1 || ++ce_depth > CE_DEPTH)
+		longjmp(ce_fail, 1);
+	old_sp = ce_sp;
+	old_bp = ce_bp;
+	ce_args(args);
+	// the return address and the saved bp, then the locals
+	ce_sp = ce_sp - 2;
+	ce_bp = ce_sp;
+	ce_sp = ce_sp - (t[1] - t[0]);
+	if (ce_sp < ce_stack)
+		longjmp(ce_fail, 1);
+	// a function that runs off its end returns whatever ax held
+	if (ce_stmt((int *) t[2]) != Return)
+		longjmp(ce_fail, 1);
+	ce_sp = old_sp;
+	ce_bp = old_bp;
+	--ce_depth;
+	return ce_ret;
+}
+
+/*
+ * ce_fold() - evaluate the call n to a pure function with constant
+ * arguments, returns whether its value is in ce_ret
+ */
+int ce_fold(int *n) {
+	struct ident *d;
+	int *a;
+
+	d = (struct ident *) n[2];
+	// a pointer could point into the sandbox
+	if (*n != Func || !d->pure || d->type >= PTR)
+		return 0;
+	for (a = (int *) n[1]; a; a = (int *) *a) {
+		if (a[1] != Num)
+			return 0;
+	}
+	if (!ce_stack && !(ce_stack = malloc(CE_STACK * sizeof(int))))
+		err_exit("error - couldn't malloc for the compile-time evaluation\n");
+	ce_sp = ce_bp = ce_stack + CE_STACK;
+	ce_steps = ce_depth = ce_seek = 0;
+	if (setjmp(ce_fail))
+		return 0;
+	ce_call(d, (int *) n[1], n[3]);
+	// the address of a local only means something in the sandbox
+	return ce_ret < (int) ce_stack || ce_ret > (int) (ce_stack + CE_STACK);
+}
+
+/*
+ * ast_check() - make sure the syntax tree pool has room for the next nodes
  *
- *		int a = 10;
- *		int aa;
- *		int *b;
- *		char **c;
- *
- * function:
- * 	<type> [*] <id> (...) {...}
- *
- * 		void foo() {...}
- *		int func(int k) {...}
- *
- *		after getting '(', it should start ...
- *			1. parse function parameters.
- *			2. parse function definition. (local variables and statements)
- *				
- * enum:
- * 	enum [<id>] {...} ;
- * 
- * struct:
- *	struct <id> {...} ;
+ * A whole program keeps the trees of every file until wp_emit(), so there
+ * it is the program that is too large, not the expression.
+ */
+void ast_check() {
+	if (ast_ptr - ast >= 64)
+		return;
+	if (whole_program)
+		err_exit("error - the program is too large for --whole-program, the syntax tree pool is full\n");
+	err_exit("error - expression too complex\n");
+}
+
+/*
+ * expr() - parse an expression whose operators bind at least as tight as level
  *
- * union:
- *	union <id> {...} ;
+ * The tree grows downwards from ast_ptr and expr_type is the type of the
+ * value it computes. An lvalue is a [Load][type] node over its address.
  */
-void parse_global_decl() {
-	int i;
-	int type;
-	int params;
-	int idx_of_locvar;
-	int decl_type;
-	int member_type;
-	int struct_token;
-	struct struct_member *m;
+void expr(int level) {
+	struct ident *d;
+	struct struct_member *sm;
+	struct op_info *op;
 
-	decl_type = INT;
+	int params_cnt, *params_b;
 
-	switch (token) {
-	case Enum:
+	int type, *old_ast_ptr, *b;
+	int size;
+
+	// bound the recursion and keep room for the nodes built before the next check
+	if (++expr_depth > 1000)
+		err_exit("error - expression too complex\n");
+	ast_check();
+
+	switch(token) {
+	case '\0': 
+		err_exit("error - unexpected EOF in an expression\n");
+	case Num:
+		*--ast_ptr = token_num;
+		*--ast_ptr = Num;
 		next();
-		if (token != '{') {
-			if (token != Id) 
-				err_exit("error - expected identifier");
+		expr_type = INT;
+		break;
+	case '"':
+		// [Global][0][address], a literal belongs to no ident
+		*--ast_ptr = token_num;
+		*--ast_ptr = 0;
+		*--ast_ptr = Global;
+		next();
+		while (token == '"')
+			next();
+		// the terminator, .rodata is zeroed
+		rodata_p++;
+		expr_type = PTR;
+		break;
+	case Sizeof:
+		next();
+		match_token('(');
+		expr_type = INT;
+		switch(token) {
+		case Int: 
+			next();
+			break;
+		case Char:
+			next();
+			expr_type = CHAR;
+			break;
+		case Struct:
+		case Union:
+			next();
+			expr_type = struct_tag();
+			break;
 		}
-		if (token == '{') {
+		while (token == Mul) {
 			next();
-			i = 0;
-			while(token != '}') {
-				if (token != Id) {
-					err_exit("error - bad enum identifier\n");
-				}
-				next();
-				if (token == Assign) {
-					// TODO: parse a string literal or an expression.
-					next();
-					// expr()
-					if (token != Num) {
-						err_exit("error - bad enum initializer\n");
-					}
-					i = token_num;
+			expr_type += PTR;
+		}
+		match_token(')');
+		*--ast_ptr = type_sizeof(expr_type);
+		*--ast_ptr = Num;
+		expr_type = INT;
+		break;
+	case Id:
+		d = id;
+		next();
+
+		if (token == '(') {
+			if (d->class != Func && d->class != Syscall) {
+				if (d->class != 0)
+					err_exit("error - bad function call\n");
+				// implicitly declared, defined further down
+				d->class = Func;
+				d->type = INT;
+			}
+			next();
+			old_ast_ptr = ast_ptr;
+			params_cnt = 0;
+			params_b = 0;
+			while (token != ')') {
+				expr(Assign);
+				*--ast_ptr = (int) params_b;
+				params_b = ast_ptr;
+				++params_cnt;
+				if (token == ',') {
 					next();
+					if (token == ')')
+						err_exit("error - unexpected comma in function call\n");
+				}
+				else if (token != ')') {
+					err_exit("error - missing comma in function call\n");
+
 				}
-				id->class = Num;
-				id->type = INT;
-				id->val = i++;
-				
-				match_token(',');
 			}
 			next();
+			// functions are called through their ident, syscalls by opcode
+			*--ast_ptr = params_cnt;
+			*--ast_ptr = d->class == Func ? (int) d : d->val;
+			*--ast_ptr = (int) params_b;
+			*--ast_ptr = d->class;
+			// declared further down, as far as a lazy body knows
+			expr_type = decl_seen(d->seq) ? d->type : INT;
+			// a pure function with constant arguments is called now
+			if (ce_fold(ast_ptr)) {
+				ast_ptr = old_ast_ptr;
+				*--ast_ptr = ce_ret;
+				*--ast_ptr = Num;
+				expr_type = INT;
+			}
+			else if (d->class == Func)
+				func_calls = d->used = 1;
+		}
+		else if (d->class == Num) {
+			if (!decl_seen(d->seq))
+				err_exit("error - undefined variable\n");
+			*--ast_ptr = d->val;
+			*--ast_ptr = Num;
+			expr_type = INT;
+		}
+		else {
+			switch(d->class) {
+			case Local:
+				*--ast_ptr = idx_of_bp - d->val;
+				*--ast_ptr = Local;
+				break;
+			case Global:
+				if (!decl_seen(d->seq))
+					err_exit("error - undefined variable\n");
+				// named by its ident, the whole program lays out globals
+				// once it knows which are used
+				*--ast_ptr = 0;
+				*--ast_ptr = (int) d;
+				*--ast_ptr = Global;
+				break;
+			default:
+				err_exit("error - undefined variable\n");			
+			}
+			*--ast_ptr = expr_type = d->type;
+			*--ast_ptr = Load;
+		}
+		break;
+	case '(':
+		next();
+		if (token == Int || token == Char || token == Struct || token == Union) {
+			// cast
+			type = INT;
+			switch (token) {
+			case Int:
+				next();
+				break;
+			case Char:
+				next();
+				type = CHAR;
+				break;
+			case Struct:
+			case Union:
+				next();
+				type = struct_tag();
+				break;
+			}
+			while (token == Mul) {
+				next();
+				type += PTR;
+			}
+			match_token(')');
+			expr(Inc);
+			expr_type = type;
+		}
+		else {
+			expr(Assign);
+			match_token(')');
+		}
+		break;
+	case Mul:
+		next();
+		expr(Inc);
+		if (expr_type < PTR)
+			err_exit("error - bad dereference\n");
+		*--ast_ptr = expr_type -= PTR;
+		*--ast_ptr = Load;
+		break;
+	case And:
+		next();
+		expr(Inc);
+		if (*ast_ptr != Load)
+			err_exit("error - bad address-of\n");
+		ast_ptr += 2;
+		expr_type += PTR;
+		// the address of a local or a member of one outlives a tail call
+		for (b = ast_ptr; *b == Add || *b == Sub; b = (int *) b[1])
+			;
+		if (*b == Local)
+			frame_escape = 1;
+		break;
+	case '!':
+		next();
+		expr(Inc);
+		node_const(Eq, 0);
+		expr_type = INT;
+		break;
+	case '~':
+		next();
+		expr(Inc);
+		node_const(Xor, -1);
+		expr_type = INT;
+		break;
+	case Add:
+		next();
+		expr(Inc);
+		break;
+	case Sub:
+		next();
+		expr(Inc);
+		node_const(Mul, -1);
+		expr_type = INT;
+		break;
+	case Inc:
+	case Dec:
+		// [Inc/Dec][type][postfix] followed by the address
+		type = token;
+		next();
+		expr(Inc);
+		if (*ast_ptr != Load)
+			err_exit("error - bad lvalue in pre-increment\n");
+		ast_ptr += 2;
+		*--ast_ptr = 0;
+		*--ast_ptr = expr_type;
+		*--ast_ptr = type;
+		break;
+	default:
+		err_exit("error - bad expression\n");
+	}
+
+	while (token >= level) {
+		type = expr_type;
+		old_ast_ptr = ast_ptr;
+		op = &op_table[token - Assign];
+		switch(op->kind) {
+		case OP_ASSIGN:
+			// [Assign][type][lvalue address] followed by the value
+			next();
+			if (*ast_ptr != Load)
+				err_exit("error - bad lvalue in assignment");
+			expr(op->rhs);
+			*--ast_ptr = (int) (old_ast_ptr + 2);
+			*--ast_ptr = expr_type = type;
+			*--ast_ptr = Assign;
+			break;
+		case OP_COND:
+			// [Cond][condition][then] followed by else
+			next();
+			expr(Assign);
+			b = ast_ptr;
+			match_token(':');
+			expr(op->rhs);
+			*--ast_ptr = (int) b;
+			*--ast_ptr = (int) old_ast_ptr;
+			*--ast_ptr = Cond;
+			break;
+		case OP_BINARY:
+			size = token;
+			next();
+			expr(op->rhs);
+			node_binary(size, old_ast_ptr);
+			expr_type = INT;
+			break;
+		case OP_ADD:
+			next();
+			expr(op->rhs);
+			if (type < PTR && expr_type >= PTR && (size = type_sizeof(expr_type - PTR)) > 1 && *old_ast_ptr != Num) {
+				// int + pointer, scale the int on the left and swap the operands
+				b = ast_ptr;
+				*--ast_ptr = size;
+				*--ast_ptr = Num;
+				*--ast_ptr = (int) old_ast_ptr;
+				*--ast_ptr = Mul;
+				*--ast_ptr = (int) b;
+				*--ast_ptr = Add;
+			}
+			else {
+				// pointer + int scales the int by the size of the element
+				if (type < PTR && expr_type >= PTR && size > 1)
+					old_ast_ptr[1] *= size;
+				else if (type >= PTR && (size = type_sizeof(type - PTR)) > 1)
+					node_const(Mul, size);
+				node_binary(Add, old_ast_ptr);
+			}
+			if (type >= PTR)
+				expr_type = type;
+			else if (expr_type < PTR)
+				expr_type = INT;
+			break;
+		case OP_SUB:
+			next();
+			expr(op->rhs);
+			size = type >= PTR ? type_sizeof(type - PTR) : 1;
+			if (type >= PTR && expr_type >= PTR) {
+				// pointer - pointer counts the elements in between
+				node_binary(Sub, old_ast_ptr);
+				if (size > 1)
+					node_const(Div, size);
+				expr_type = INT;
+			}
+			else {
+				if (size > 1)
+					node_const(Mul, size);
+				node_binary(Sub, old_ast_ptr);
+				expr_type = type >= PTR ? type : INT;
+			}
+			break;
+		case OP_POSTFIX:
+			// [Inc/Dec][type][postfix] followed by the address
+			if (*ast_ptr != Load)
+				err_exit("error - bad lvalue in post-increment\n");
+			ast_ptr += 2;
+			*--ast_ptr = 1;
+			*--ast_ptr = type;
+			*--ast_ptr = token;
+			next();
+			break;
+		case OP_MEMBER:
+			if (token == Dot) {
+				if (*ast_ptr != Load || type >= PTR || type < type_builtin)
+					err_exit("error - request for a member in a non struct\n");
+				// the address of the struct instead of its value
+				ast_ptr += 2;
+			}
+			else {
+				if (type < PTR || type >= PTR2 || type - PTR < type_builtin)
+					err_exit("error - bad pointer to struct\n");
+				type -= PTR;
+			}
+			next();
+			if (token != Id)
+				err_exit("error - expected member name\n");
+			if (!(sm = struct_member(type, id)))
+				err_exit("error - no such struct member\n");
+			next();
+			if (sm->offset)
+				node_const(Add, sm->offset);
+			*--ast_ptr = expr_type = sm->type;
+			*--ast_ptr = Load;
+			break;
+		case OP_INDEX:
+			// a[i] is *(a + i)
+			next();
+			expr(op->rhs);
+			match_token(']');
+			if (type < PTR)
+				err_exit("error - subscript of a non pointer\n");
+			if ((size = type_sizeof(type - PTR)) > 1)
+				node_const(Mul, size);
+			node_binary(Add, old_ast_ptr);
+			*--ast_ptr = expr_type = type - PTR;
+			*--ast_ptr = Load;
+			break;
+		}
+	}
+
+	ast_check();
+	--expr_depth;
+}
+
+void gen(int *n);
+
+// set in the threads of gen_funcs()
+__thread int gen_threaded;
+
+/*
+ * gen_args() - push the arguments of a call, the first one first
+ *
+ * The argument list is linked from the last argument to the first.
+ */
+void gen_args(int *arg) {
+	if (!arg)
+		return;
+	gen_args((int *) *arg);
+	gen(arg + 1);
+	*++text_p = PUSH;
+	++sp_depth;
+}
+
+/*
+ * gen_target() - emit the address of function d as the operand of a CALL
+ * or JMP, chained to the other uses while d is not defined yet
+ *
+ * A codegen thread doesn't know where d goes, it leaves a relocation.
+ */
+void gen_target(struct ident *d) {
+	++text_p;
+	if (gen_threaded) {
+		// the relocations grow to the next power of two
+		if (!(cur_ir->nreloc & (cur_ir->nreloc - 1)) &&
+		    !(cur_ir->reloc = realloc(cur_ir->reloc, (cur_ir->nreloc ? cur_ir->nreloc * 2 : 1) * 2 * sizeof(int))))
+			err_exit("could not malloc for the relocations\n");
+		cur_ir->reloc[cur_ir->nreloc * 2] = text_p - cur_ir->code;
+		cur_ir->reloc[cur_ir->nreloc++ * 2 + 1] = (int) d;
+		*text_p = 0;
+	}
+	else if (d->val)
+		*text_p = d->val;
+	else {
+		*text_p = (int) d->fixup;
+		d->fixup = text_p;
+	}
+}
+
+/*
+ * patch_jumps() - point the jumps recorded in list[from..to) at target
+ */
+void patch_jumps(int *list, int from, int to, int *target) {
+	while (from < to)
+		*(int *) list[from++] = (int) target;
+}
+
+/*
+ * Profile-guided optimization. A run with --pgo-gen counts how often every
+ * BZ, BNZ and CALL that belongs to a site executes and how often its
+ * branch is taken, and writes per site how often it ran and how often its
+ * condition held. --pgo-use reads that back for block layout, switch case
+ * order and inlining.
+ *
+ * A site is an If, Cond, loop, Lor, Lan, Case or Func node. It is named by
+ * its function and its number in a fixed walk of the function's tree, so
+ * the names stay the same however the profile changes the code.
+ */
+enum {PGO_SITES = 8192, PGO_INLINE_MIN = 16};
+
+struct pgo_mark {
+	int *pc;
+	struct ident *func;
+	int site;
+} *pgo_marks;
+int pgo_nmarks;
+
+struct pgo_entry {
+	char *name;
+	int len;
+	int site;
+	int count;
+	int cond;
+} *pgo_prof;
+int pgo_nprof;
+
+// node -> site number, open addressing, and the counts of the current function
+int *pgo_node, *pgo_num, *pgo_used, pgo_nsites;
+int *pgo_cnt, *pgo_cond, *pgo_label;
+// cold blocks cut out of the function: [tree][jump operand][return address]
+// [sp_depth][inline_bp][inline_base], what gen() needs to address locals there
+enum {COLD_SIZE = 6};
+int *cold_list;
+__thread int cold_cnt;
+int *pgo_exec, *pgo_taken;
+__thread int inline_bp, inline_base, inline_depth;
+// how deep inlined calls may nest in inlined expressions
+enum {INLINE_DEPTH = 4};
+
+int pgo_slot(int *n) {
+	int h;
+
+	h = ((unsigned) (int) n / sizeof(int)) & (PGO_SITES * 2 - 1);
+	while (pgo_node[h] && pgo_node[h] != (int) n)
+		h = (h + 1) & (PGO_SITES * 2 - 1);
+	return h;
+}
+
+/*
+ * pgo_site() - the site number of node n, or -1 when n is no site
+ */
+int pgo_site(int *n) {
+	int h;
+
+	if (!pgo_node)
+		return -1;
+	h = pgo_slot(n);
+	return pgo_node[h] ? pgo_num[h] : -1;
+}
+
+void pgo_add(int *n) {
+	int h;
+
+	if (pgo_nsites == PGO_SITES)
+		return;
+	pgo_label[pgo_nsites] = 0;
+	h = pgo_slot(n);
+	pgo_node[h] = (int) n;
+	pgo_num[h] = pgo_nsites;
+	pgo_used[pgo_nsites++] = h;
+}
+
+/*
+ * pgo_number() - number the sites of a tree, children in a fixed order
+ *
+ * Returns whether the tree holds a case label; such an If is never split,
+ * its branches have to stay inside the switch.
+ */
+int pgo_number(int *n) {
+	int *a, i, label;
+
+	if (!n)
+		return 0;
+	label = 0;
+	switch (*n) {
+	case Num:
+	case Global:
+	case Local:
+	case Break:
+	case Continue:
+		break;
+	case Case:
+		pgo_add(n);
+	case Default:
+		label = 1;
+		break;
+	case Load:
+	case Inc:
+	case Dec:
+		label = pgo_number(n + (*n == Load ? 2 : 3));
+		break;
+	case Assign:
+		label = pgo_number((int *) n[2]);
+		label |= pgo_number(n + 3);
+		break;
+	case Cond:
+	case If:
+		i = pgo_nsites;
+		pgo_add(n);
+		label = pgo_number((int *) n[1]);
+		label |= pgo_number((int *) n[2]);
+		label |= pgo_number(*n == Cond ? n + 3 : (int *) n[3]);
+		if (i < pgo_nsites)
+			pgo_label[i] = label;
+		break;
+	case Func:
+	case Syscall:
+		if (*n == Func)
+			pgo_add(n);
+		for (a = (int *) n[1]; a; a = (int *) *a)
+			pgo_number(a + 1);
+		break;
+	case ';':
+	case Return:
+		label = pgo_number((int *) n[1]);
+		break;
+	case While:
+	case DoWhile:
+	case Switch:
+		if (*n != Switch)
+			pgo_add(n);
+		pgo_number((int *) n[1]);
+		label = pgo_number((int *) n[2]);
+		// the labels of a nested switch are its own
+		if (*n == Switch)
+			label = 0;
+		break;
+	case For:
+		pgo_add(n);
+		pgo_number((int *) n[1]);
+		pgo_number((int *) n[2]);
+		pgo_number((int *) n[3]);
+		label = pgo_number((int *) n[4]);
+		break;
+	case Lor:
+	case Lan:
+		pgo_add(n);
+	default:
+		// '{' and the binary operators
+		label = pgo_number((int *) n[1]);
+		label |= pgo_number(n + 2);
+	}
+	return label;
+}
+
+/*
+ * pgo_begin() - number the sites of a function body and look up their counts
+ */
+void pgo_begin(int *body) {
+	int i;
+	struct pgo_entry *e;
+
+	if (!pgo_node) {
+		pgo_node = calloc(PGO_SITES * 2, sizeof(int));
+		pgo_num = malloc(PGO_SITES * 2 * sizeof(int));
+		pgo_used = malloc(PGO_SITES * sizeof(int));
+		pgo_cnt = malloc(PGO_SITES * sizeof(int));
+		pgo_cond = malloc(PGO_SITES * sizeof(int));
+		pgo_label = malloc(PGO_SITES * sizeof(int));
+		cold_list = malloc(PGO_SITES * COLD_SIZE * sizeof(int));
+		if (!pgo_node || !pgo_num || !pgo_used || !pgo_cnt || !pgo_cond || !pgo_label || !cold_list)
+			err_exit("could not malloc for the pgo sites\n");
+	}
+	while (pgo_nsites)
+		pgo_node[pgo_used[--pgo_nsites]] = 0;
+	pgo_number(body);
+
+	memset(pgo_cnt, 0, pgo_nsites * sizeof(int));
+	memset(pgo_cond, 0, pgo_nsites * sizeof(int));
+	i = cur_func->hash & 0x3f;
+	for (e = pgo_prof; e < pgo_prof + pgo_nprof; e++) {
+		if (e->len == i && !memcmp(e->name, cur_func->name, i) && e->site < pgo_nsites) {
+			pgo_cnt[e->site] = e->count;
+			pgo_cond[e->site] = e->cond;
+		}
+	}
+}
+
+/*
+ * pgo_count() - how often the site n ran in the profile, and in *cond how
+ * often its condition held
+ */
+int pgo_count(int *n, int *cond) {
+	int i;
+
+	*cond = 0;
+	if (!pgo_use || (i = pgo_site(n)) < 0)
+		return 0;
+	*cond = pgo_cond[i];
+	return pgo_cnt[i];
+}
+
+/*
+ * pgo_mark() - remember that the BZ, BNZ or CALL at pc belongs to site n
+ */
+void pgo_mark(int *n, int *pc) {
+	int i;
+
+	if (!pgo_gen || (i = pgo_site(n)) < 0)
+		return;
+	if (!pgo_marks && !(pgo_marks = malloc(pool_size / sizeof(int) * sizeof(struct pgo_mark))))
+		err_exit("could not malloc for the pgo sites\n");
+	if (pgo_nmarks == pool_size / sizeof(int))
+		return;
+	pgo_marks[pgo_nmarks].pc = pc;
+	pgo_marks[pgo_nmarks].func = cur_func;
+	pgo_marks[pgo_nmarks++].site = i;
+}
+
+/*
+ * pgo_write() - write the counts of the --pgo-gen run
+ *
+ * One site per line: "<function> <site> <count> <condition held>".
+ */
+void pgo_write() {
+	FILE *f;
+	struct pgo_mark *m;
+	int i, cond;
+
+	if (!(f = fopen(pgo_gen, "w"))) {
+		fprintf(stderr, "error - couldn't write the profile %s\n", pgo_gen);
+		return;
+	}
+	fprintf(f, "# maxcc pgo profile: function site count condition-held\n");
+	for (m = pgo_marks; m < pgo_marks + pgo_nmarks; m++) {
+		i = m->pc - text;
+		cond = *m->pc == BZ ? pgo_exec[i] - pgo_taken[i] : *m->pc == BNZ ? pgo_taken[i] : 0;
+		fprintf(f, "%.*s %d %d %d\n", m->func->hash & 0x3f, m->func->name, m->site, pgo_exec[i], cond);
+	}
+	fclose(f);
+}
+
+/*
+ * pgo_read() - load the profile for --pgo-use
+ */
+void pgo_read() {
+	FILE *f;
+	char line[256], name[64];
+	int max, site, count, cond;
+
+	if (!(f = fopen(pgo_use, "r"))) {
+		fprintf(stderr, "error - for profile %s\n", pgo_use);
+		err_exit("couldn't open the profile\n");
+	}
+	max = pgo_nprof = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (*line == '#' || sscanf(line, "%63s %d %d %d", name, &site, &count, &cond) != 4)
+			continue;
+		if (pgo_nprof == max) {
+			max = max ? max * 2 : 256;
+			if (!(pgo_prof = realloc(pgo_prof, max * sizeof(struct pgo_entry))))
+				err_exit("could not malloc for the profile\n");
+		}
+		pgo_prof[pgo_nprof].len = strlen(name);
+		pgo_prof[pgo_nprof].name = malloc(pgo_prof[pgo_nprof].len);
+		memcpy(pgo_prof[pgo_nprof].name, name, pgo_prof[pgo_nprof].len);
+		pgo_prof[pgo_nprof].site = site;
+		pgo_prof[pgo_nprof].count = count;
+		pgo_prof[pgo_nprof++].cond = cond;
+	}
+	fclose(f);
+}
+
+/*
+ * pgo_defer() - cut the cold tree n out of line, the jump operand at site
+ * is patched to it once it is emitted and it jumps back to text_p + 1
+ */
+void pgo_defer(int *n, int *site) {
+	int *c;
+
+	if (cold_cnt == PGO_SITES)
+		err_exit("error - too many cold blocks\n");
+	c = cold_list + cold_cnt++ * COLD_SIZE;
+	c[0] = (int) n;
+	c[1] = (int) site;
+	c[2] = (int) (text_p + 1);
+	c[3] = sp_depth;
+	c[4] = inline_bp;
+	c[5] = inline_base;
+}
+
+/*
+ * pgo_flush() - emit the cold blocks deferred since first
+ *
+ * This happens behind the loop or switch they were cut from, so break and
+ * continue in them are patched with the others of that loop or switch, and
+ * behind the function for the rest.
+ */
+void pgo_flush(int first) {
+	int i, *c, depth, bp, base;
+
+	depth = sp_depth;
+	bp = inline_bp;
+	base = inline_base;
+	for (i = first; i < cold_cnt; i++) {
+		// the block runs with the stack and the inlined frame of its site
+		c = cold_list + i * COLD_SIZE;
+		*(int *) c[1] = (int) (text_p + 1);
+		sp_depth = c[3];
+		inline_bp = c[4];
+		inline_base = c[5];
+		gen((int *) c[0]);
+		*++text_p = JMP;
+		*++text_p = c[2];
+	}
+	sp_depth = depth;
+	inline_bp = bp;
+	inline_base = base;
+	cold_cnt = first;
+}
+
+/*
+ * pgo_loop_exit() - emit the cold blocks of a loop behind its exit
+ */
+void pgo_loop_exit(int first, int old_continue, int *cont) {
+	int *a;
+
+	if (cold_cnt == first)
+		return;
+	*++text_p = JMP;
+	a = ++text_p;
+	pgo_flush(first);
+	*a = (int) (text_p + 1);
+	patch_jumps(continue_addr, old_continue, continue_cnt, cont);
+	continue_cnt = old_continue;
+}
+
+/*
+ * pgo_order_cases() - sort the cases from first on by how often they were
+ * taken, the values are distinct so any order compares the same
+ */
+void pgo_order_cases(int first) {
+	int i, j, t, hot, cold;
+
+	for (i = first + 1; i < switch_cnt; i++) {
+		for (j = i; j > first; j--) {
+			pgo_count((int *) case_node[j - 1], &cold);
+			pgo_count((int *) case_node[j], &hot);
+			if (cold >= hot)
+				break;
+			t = case_val[j]; case_val[j] = case_val[j - 1]; case_val[j - 1] = t;
+			t = case_addr[j]; case_addr[j] = case_addr[j - 1]; case_addr[j - 1] = t;
+			t = case_node[j]; case_node[j] = case_node[j - 1]; case_node[j - 1] = t;
+		}
+	}
+}
+
+/*
+ * inline_call() - whether the call n is expanded in place
+ *
+ * It has to be a hot call to a function that only returns an expression.
+ * Storing an argument in a temporary costs two instructions more than
+ * pushing it, so with more than two arguments the call is cheaper.
+ */
+int inline_call(int *n) {
+	struct ident *d;
+	int cond;
+
+	d = (struct ident *) n[2];
+	// the register form has no slots for the parameters of an inlined call
+	if (*n != Func || !d->inline_tree || d == cur_func || n[3] != d->inline_tree[0] - 1 ||
+	    n[3] > 2 || inline_depth >= INLINE_DEPTH || reg_vm)
+		return 0;
+	// the whole program inlines every small function, a profile only hot calls
+	return pgo_use ? pgo_count(n, &cond) >= PGO_INLINE_MIN : whole_program;
+}
+
+/*
+ * gen_inline_args() - store the arguments of an inlined call in the
+ * temporaries from slot down, the last argument in slot
+ */
+void gen_inline_args(int *arg, int slot) {
+	if (!arg)
+		return;
+	gen_inline_args((int *) *arg, slot - 1);
+	*++text_p = LEA;
+	*++text_p = idx_of_bp - slot;
+	*++text_p = PUSH;
+	++sp_depth;
+	gen(arg + 1);
+	*++text_p = SW;
+	--sp_depth;
+}
+
+/*
+ * gen_inline() - expand the call n to a function that returns an expression
+ *
+ * The arguments go to temporaries behind the locals of the caller, the
+ * parameters of the inlined expression are redirected to them.
+ */
+void gen_inline(int *n, struct ident *d) {
+	int base, old_bp, old_base;
+
+	base = local_var_depth + 1;
+	local_var_depth = local_var_depth + n[3];
+	if (local_var_depth > frame_max)
+		frame_max = local_var_depth;
+	gen_inline_args((int *) n[1], local_var_depth);
+
+	old_bp = inline_bp;
+	old_base = inline_base;
+	inline_bp = d->inline_tree[0];
+	inline_base = base;
+	++inline_depth;
+	gen((int *) d->inline_tree[1]);
+	--inline_depth;
+	inline_bp = old_bp;
+	inline_base = old_base;
+	local_var_depth = base - 1;
+}
+
+/*
+ * konst_param() - the parameter the Load n reads when every call passes it
+ * the same constant, or -1
+ */
+int konst_param(int *n) {
+	int i;
+
+	if (n[2] != Local || inline_bp || (i = cur_ir->params - n[3]) < 0 || i >= WP_PARAMS ||
+	    i >= cur_ir->params - 1 || cur_ir->kstate[i] != 1)
+		return -1;
+	return i;
+}
+
+/*
+ * Loop vectorization for the RISC-V target. A for loop the RVV code can
+ * run is described in a VEC instruction ahead of its condition:
+ * for (i = ...; i < n; i++) with a body of one p[i] = e or s = s op e,
+ * where every array is indexed by i alone and has the one element type
+ * and e is built from + - * & | ^, shifts by constants (left only on char
+ * elements), i and values the loop doesn't change. The descriptor is
+ *	[size][frame][i][bound kind][bound][bases] {[kind][slot]} x VEC_BASES
+ *	[dst][reduce op][reduce slot][len] {e}
+ * where a word the loop reads is [Num][value], [Local][slot] or
+ * [Global][address], dst is the base stored to or -1 for a reduction
+ * and e is in postfix. The scalar loop stays behind it, for the iterations
+ * the vector loop didn't run and for arrays that overlap.
+ */
+enum {VEC_DESC = 256, VEC_BASES = 4, VEC_HEAD = 18, VEC_REGS = 16};
+int vec_loops;
+int *vec_pool, vec_cnt;
+__thread int vec_buf[VEC_DESC], vec_len, vec_elem, vec_i, vec_red, vec_sp;
+
+/*
+ * vec_slot() - the frame slot a Local node is in, as gen() addresses it,
+ * or INT_MIN when a load or store can't reach it with one offset
+ */
+int vec_slot(int *n) {
+	int i;
+
+	if (*n != Local)
+		return INT_MIN;
+	i = elide ? n[1] - 1 + sp_depth : inline_bp ? idx_of_bp - (inline_base + inline_bp - n[1]) : n[1];
+	return i * 4 >= -2048 && i * 4 < 2048 ? i : INT_MIN;
+}
+
+/*
+ * vec_scalar() - store [kind][value] of a word the loop only reads, from
+ * the Load n, at v
+ */
+int vec_scalar(int *n, int *v) {
+	int i;
+
+	if (*n != Load || (n[1] != INT && n[1] < PTR))
+		return 0;
+	if ((i = konst_param(n)) >= 0) {
+		v[0] = Num;
+		v[1] = cur_ir->konst[i];
+		return 1;
+	}
+	if (n[2] == Global) {
+		v[0] = Global;
+		v[1] = (n[3] ? ((struct ident *) n[3])->val : 0) + n[4];
+		return 1;
+	}
+	if ((i = vec_slot(n + 2)) == INT_MIN || i == vec_i || i == vec_red)
+		return 0;
+	v[0] = Local;
+	v[1] = i;
+	return 1;
+}
+
+/*
+ * vec_index() - the base of the element address a, indexed by i alone, as
+ * a number in the bases of the descriptor, or -1
+ */
+int vec_index(int *a) {
+	int *b, *x, v[2], i;
+
+	if (*a != Add)
+		return -1;
+	b = (int *) a[1];
+	x = a + 2;
+	// only elements wider than a byte have i scaled
+	if ((i = type_sizeof(vec_elem)) > 1) {
+		if (*x != Mul || x[2] != Num || x[3] != i)
+			return -1;
+		x = (int *) x[1];
+	}
+	if (*x != Load || x[1] != INT || vec_slot(x + 2) != vec_i)
+		return -1;
+	if (*b != Load || b[1] != PTR + vec_elem || !vec_scalar(b, v) || *v == Num)
+		return -1;
+	for (i = 0; i < vec_buf[5]; i++)
+		if (vec_buf[6 + i * 2] == v[0] && vec_buf[7 + i * 2] == v[1])
+			return i;
+	if (i == VEC_BASES)
+		return -1;
+	vec_buf[6 + i * 2] = v[0];
+	vec_buf[7 + i * 2] = v[1];
+	vec_buf[5]++;
+	return i;
+}
+
+/*
+ * vec_push() - append n words to the descriptor
+ */
+int vec_push(int a, int b, int n) {
+	if (vec_len + n > VEC_DESC || (n == 2 && ++vec_sp > VEC_REGS))
+		return 0;
+	vec_buf[vec_len++] = a;
+	if (n == 2)
+		vec_buf[vec_len++] = b;
+	return 1;
+}
+
+/*
+ * vec_expr() - append the element-wise tree n in postfix
+ */
+int vec_expr(int *n) {
+	int v[2], i;
+
+	switch (*n) {
+	case Num:
+		return vec_push(Num, n[1], 2);
+	case Load:
+		if (n[1] == vec_elem && (i = vec_index(n + 2)) >= 0)
+			return vec_push(Load, i, 2);
+		// i itself, the lanes count up from it
+		if (n[1] == INT && vec_slot(n + 2) == vec_i)
+			return vec_push(Id, 0, 2);
+		return vec_scalar(n, v) && vec_push(v[0], v[1], 2);
+	case Shr:
+		// char lanes hold the low byte of the int a shift right would
+		// bring its upper bits down from
+		if (vec_elem == CHAR)
+			return 0;
+	case Shl:
+		// the lanes shift by their low bits only
+		if (n[2] != Num || n[3] < 0 || n[3] >= (vec_elem == CHAR ? 8 : 32))
+			return 0;
+	case Or:
+	case Xor:
+	case And:
+	case Add:
+	case Sub:
+	case Mul:
+		if (!vec_expr((int *) n[1]) || !vec_expr(n + 2))
+			return 0;
+		--vec_sp;
+		return vec_push(*n, 0, 1);
+	}
+	return 0;
+}
+
+/*
+ * vec_match() - describe the For n for the vectorizer, or return 0
+ */
+int vec_match(int *n) {
+	int *c, *s, *b, *e, i;
+
+	vec_len = VEC_HEAD;
+	vec_red = INT_MIN;
+	vec_sp = 0;
+	memset(vec_buf, 0, vec_len * sizeof(int));
+
+	// i < n
+	if (!(c = (int *) n[2]) || *c != Lt || *(b = (int *) c[1]) != Load || b[1] != INT ||
+	    (vec_i = vec_slot(b + 2)) == INT_MIN || !vec_scalar(c + 2, vec_buf + 3))
+		return 0;
+	// i++, ++i or i = i + 1
+	if (!(s = (int *) n[3]))
+		return 0;
+	if (*s == Inc) {
+		if (s[1] != INT || vec_slot(s + 3) != vec_i)
+			return 0;
+	}
+	else if (*s != Assign || s[1] != INT || vec_slot((int *) s[2]) != vec_i || s[3] != Add ||
+		 *(b = (int *) s[4]) != Load || vec_slot(b + 2) != vec_i || s[5] != Num || s[6] != 1)
+		return 0;
+
+	b = (int *) n[4];
+	if (*b == ';')
+		b = (int *) b[1];
+	if (!b || *b != Assign)
+		return 0;
+	e = b + 3;
+	if ((i = vec_slot((int *) b[2])) != INT_MIN) {
+		// s = s op e or s = e op s
+		if (i == vec_i || b[1] != INT || (*e != Add && *e != Or && *e != Xor && *e != And))
+			return 0;
+		vec_elem = INT;
+		vec_red = i;
+		c = (int *) e[1];
+		if (*c == Load && c[1] == INT && vec_slot(c + 2) == i)
+			c = e + 2;
+		else if (e[2] != Load || e[3] != INT || vec_slot(e + 4) != i)
+			return 0;
+		// the bound can't be what the loop sums
+		if (vec_buf[3] == Local && vec_buf[4] == i)
+			return 0;
+		vec_buf[14] = -1;
+		vec_buf[15] = *e;
+		vec_buf[16] = i;
+		e = c;
+	}
+	else {
+		// p[i] = e
+		if (b[1] != INT && b[1] != CHAR)
+			return 0;
+		vec_elem = b[1];
+		if ((vec_buf[14] = vec_index((int *) b[2])) < 0)
+			return 0;
+	}
+	if (!vec_expr(e))
+		return 0;
+
+	vec_buf[0] = type_sizeof(vec_elem);
+	vec_buf[1] = elide;
+	vec_buf[2] = vec_i;
+	vec_buf[17] = vec_len - VEC_HEAD;
+	if ((i = __sync_fetch_and_add(&vec_cnt, vec_len)) + vec_len > pool_size / sizeof(int))
+		return 0;
+	memcpy(vec_pool + i, vec_buf, vec_len * sizeof(int));
+	return (int) (vec_pool + i);
+}
+
+/*
+ * gen() - emit the instructions which evaluate a tree into ax
+ *
+ * Statement trees are emitted the same way and leave nothing behind.
+ * Loops are laid out with the condition at the bottom, so every iteration
+ * only takes one branch.
+ */
+void gen(int *n) {
+	int i, j, *a, *b, *c;
+	int old_break, old_continue, old_switch, old_cold, *old_default;
+
+	if (text_p > text_limit)
+		err_exit("error - text segment overflow\n");
+
+	switch (*n) {
+	case Num:
+		*++text_p = IMM;
+		*++text_p = n[1];
+		break;
+	case Global:
+		*++text_p = IMMD;
+		*++text_p = (n[1] ? ((struct ident *) n[1])->val : 0) + n[2];
+		break;
+	case Local:
+		if (elide) {
+			// no frame, bp would be one below the return address
+			*++text_p = LEAS;
+			*++text_p = n[1] - 1 + sp_depth;
+			break;
+		}
+		*++text_p = LEA;
+		// parameter inline_bp - n[1] of an inlined function
+		*++text_p = inline_bp ? idx_of_bp - (inline_base + inline_bp - n[1]) : n[1];
+		break;
+	case Load:
+		// a parameter that every call passes the same constant
+		if ((i = konst_param(n)) >= 0) {
+			*++text_p = IMM;
+			*++text_p = n[1] == CHAR ? (char) cur_ir->konst[i] : cur_ir->konst[i];
+			break;
+		}
+		gen(n + 2);
+		// a struct is used through its address
+		if (n[1] == CHAR)
+			*++text_p = LC;
+		else if (n[1] >= PTR || n[1] < type_builtin)
+			*++text_p = LW;
+		break;
+	case Assign:
+		gen((int *) n[2]);
+		*++text_p = PUSH;
+		++sp_depth;
+		gen(n + 3);
+		*++text_p = n[1] == CHAR ? SC : SW;
+		--sp_depth;
+		break;
+	case Inc:
+	case Dec:
+		i = n[1] >= PTR ? type_sizeof(n[1] - PTR) : 1;
+		gen(n + 3);
+		*++text_p = PUSH;
+		*++text_p = n[1] == CHAR ? LC : LW;
+		*++text_p = PUSH;
+		*++text_p = IMM;
+		*++text_p = i;
+		*++text_p = *n == Inc ? ADD : SUB;
+		*++text_p = n[1] == CHAR ? SC : SW;
+		if (n[2]) {
+			// postfix, give back the old value
+			*++text_p = PUSH;
+			*++text_p = IMM;
+			*++text_p = i;
+			*++text_p = *n == Inc ? SUB : ADD;
+		}
+		break;
+	case Cond:
+	case If:
+		// [Cond][cond][then] else  /  [If][cond][then][else or 0]
+		b = *n == Cond ? n + 3 : (int *) n[3];
+		gen((int *) n[1]);
+		// with both branches, the colder one moves out of line and the
+		// hot one falls through without the jump over the other
+		i = pgo_count(n, &j);
+		if (b && j < i - j && !pgo_label[pgo_site(n)]) {
+			*++text_p = BNZ;
+			pgo_mark(n, text_p);
+			a = ++text_p;
+			gen(b);
+			pgo_defer((int *) n[2], a);
+			break;
+		}
+		if (b && j > i - j && !pgo_label[pgo_site(n)]) {
+			*++text_p = BZ;
+			pgo_mark(n, text_p);
+			a = ++text_p;
+			gen((int *) n[2]);
+			pgo_defer(b, a);
+			break;
+		}
+		*++text_p = BZ;
+		pgo_mark(n, text_p);
+		a = ++text_p;
+		gen((int *) n[2]);
+		if (b) {
+			*++text_p = JMP;
+			*a = (int) (text_p + 2);
+			a = ++text_p;
+			gen(b);
+		}
+		*a = (int) (text_p + 1);
+		break;
+	case Lor:
+	case Lan:
+		// the result is normalized to 0 or 1
+		gen((int *) n[1]);
+		*++text_p = *n == Lor ? BNZ : BZ;
+		pgo_mark(n, text_p);
+		a = ++text_p;
+		gen(n + 2);
+		*++text_p = *n == Lor ? BNZ : BZ;
+		b = ++text_p;
+		*++text_p = IMM;
+		*++text_p = *n == Lan;
+		*++text_p = JMP;
+		++text_p;
+		*text_p = (int) (text_p + 3);
+		*a = *b = (int) (text_p + 1);
+		*++text_p = IMM;
+		*++text_p = *n == Lor;
+		break;
+	case Func:
+	case Syscall:
+		// [Func][args][ident][count]  /  [Syscall][args][opcode][count]
+		if (inline_call(n)) {
+			gen_inline(n, (struct ident *) n[2]);
+			break;
+		}
+		gen_args((int *) n[1]);
+		if (*n == Syscall) {
+			*++text_p = n[2];
+		}
+		else {
+			*++text_p = CALL;
+			pgo_mark(n, text_p);
+			gen_target((struct ident *) n[2]);
+		}
+		if (n[3]) {
+			*++text_p = ADJ;
+			*++text_p = n[3];
+			sp_depth -= n[3];
+		}
+		break;
+	case ';':
+		if (n[1])
+			gen((int *) n[1]);
+		break;
+	case '{':
+		gen((int *) n[1]);
+		gen(n + 2);
+		break;
+	case While:
+	case For:
+		// [While][cond][body]  /  [For][init][cond][step][body]
+		if (*n == For && n[1])
+			gen((int *) n[1]);
+		if (*n == For && vec_loops && (i = vec_match(n))) {
+			*++text_p = VEC;
+			*++text_p = i;
+		}
+		*++text_p = JMP;
+		a = ++text_p;
+		b = text_p + 1;
+		old_break = break_cnt;
+		old_continue = continue_cnt;
+		old_cold = cold_cnt;
+		gen((int *) n[*n == For ? 4 : 2]);
+		c = text_p + 1;
+		patch_jumps(continue_addr, old_continue, continue_cnt, c);
+		continue_cnt = old_continue;
+		if (*n == For && n[3])
+			gen((int *) n[3]);
+		*a = (int) (text_p + 1);
+		if (*n == For && !n[2]) {
+			*++text_p = JMP;
+			*++text_p = (int) b;
+		}
+		else {
+			gen((int *) n[*n == For ? 2 : 1]);
+			*++text_p = BNZ;
+			pgo_mark(n, text_p);
+			*++text_p = (int) b;
+		}
+		pgo_loop_exit(old_cold, old_continue, c);
+		patch_jumps(break_addr, old_break, break_cnt, text_p + 1);
+		break_cnt = old_break;
+		break;
+	case DoWhile:
+		b = text_p + 1;
+		old_break = break_cnt;
+		old_continue = continue_cnt;
+		old_cold = cold_cnt;
+		gen((int *) n[2]);
+		c = text_p + 1;
+		patch_jumps(continue_addr, old_continue, continue_cnt, c);
+		continue_cnt = old_continue;
+		gen((int *) n[1]);
+		*++text_p = BNZ;
+		pgo_mark(n, text_p);
+		*++text_p = (int) b;
+		pgo_loop_exit(old_cold, old_continue, c);
+		patch_jumps(break_addr, old_break, break_cnt, text_p + 1);
+		break_cnt = old_break;
+		break;
+	case Switch:
+		// [Switch][cond][body][slot], the value is kept in a hidden local
+		*++text_p = LEA;
+		*++text_p = n[3];
+		*++text_p = PUSH;
+		++sp_depth;
+		gen((int *) n[1]);
+		*++text_p = SW;
+		--sp_depth;
+		*++text_p = JMP;
+		a = ++text_p;
+
+		old_break = break_cnt;
+		old_switch = switch_cnt;
+		old_cold = cold_cnt;
+		old_default = default_addr;
+		default_addr = 0;
+		gen((int *) n[2]);
+		*++text_p = JMP;
+		b = ++text_p;
+
+		// compare against every case in source order, or the hottest first
+		if (pgo_use)
+			pgo_order_cases(old_switch);
+		*a = (int) (text_p + 1);
+		for (i = old_switch; i < switch_cnt; i++) {
+			*++text_p = LEA;
+			*++text_p = n[3];
+			*++text_p = LW;
+			*++text_p = PUSH;
+			*++text_p = IMM;
+			*++text_p = case_val[i];
+			*++text_p = EQ;
+			*++text_p = BNZ;
+			pgo_mark((int *) case_node[i], text_p);
+			*++text_p = case_addr[i];
+		}
+		*++text_p = JMP;
+		a = ++text_p;
+		pgo_flush(old_cold);
+		*a = default_addr ? (int) default_addr : (int) (text_p + 1);
+		*b = (int) (text_p + 1);
+		patch_jumps(break_addr, old_break, break_cnt, text_p + 1);
+		break_cnt = old_break;
+		switch_cnt = old_switch;
+		default_addr = old_default;
+		break;
+	case Case:
+		if (switch_cnt >= pool_size / sizeof(int))
+			err_exit("error - too many case labels\n");
+		case_val[switch_cnt] = n[1];
+		case_node[switch_cnt] = (int) n;
+		case_addr[switch_cnt++] = (int) (text_p + 1);
+		break;
+	case Default:
+		default_addr = text_p + 1;
+		break;
+	case Break:
+	case Continue:
+		*++text_p = JMP;
+		++text_p;
+		if (*n == Break) {
+			if (break_cnt >= pool_size / sizeof(int))
+				err_exit("error - too many break statements\n");
+			break_addr[break_cnt++] = (int) text_p;
+		}
+		else {
+			if (continue_cnt >= pool_size / sizeof(int))
+				err_exit("error - too many continue statements\n");
+			continue_addr[continue_cnt++] = (int) text_p;
+		}
+		break;
+	case Return:
+		a = (int *) n[1];
+		if (a && *a == Func && !keep_frames && !frame_escape && a[3] < idx_of_bp && !inline_call(a)) {
+			// a call in tail position: its arguments replace ours and it
+			// returns to our caller
+			gen_args((int *) a[1]);
+			*++text_p = TAIL;
+			pgo_mark(a, text_p);
+			*++text_p = a[3];
+			sp_depth -= a[3];
+			*++text_p = JMP;
+			gen_target((struct ident *) a[2]);
+			break;
+		}
+		if (a)
+			gen(a);
+		*++text_p = elide ? RET : LEV;
+		break;
+	default:
+		// binary operators map onto OR..MOD in the same order
+		if (*n < Or || *n > Mod)
+			err_exit("error - unknown tree node\n");
+		gen((int *) n[1]);
+		*++text_p = PUSH;
+		++sp_depth;
+		gen(n + 2);
+		*++text_p = OR + *n - Or;
+		--sp_depth;
+	}
+}
+
+/*
+ * The register form for --reg-vm. An expression leaves its value in a slot
+ * of the frame and returns the slot, an instruction names its operands by
+ * their slots relative to bp. A local whose address is never taken is its
+ * own slot, so "i = i + 1" is one ADDI. The temporaries sit below the
+ * locals and are handed out like a stack, rtemp of them are in use. Calls
+ * push their arguments and find their parameters as in the stack form.
+ */
+__thread int rtemp, rtemp_max, rbase, rdiscard;
+// the last instruction, while the slot it writes can still be renamed
+__thread int *rlast;
+
+int *remit(int op, int d, int a, int b) {
+	rlast = text_p + 1;
+	*++text_p = op;
+	*++text_p = d;
+	*++text_p = a;
+	*++text_p = b;
+	return rlast;
+}
+
+/*
+ * rhere() - the address of the next instruction, which some jump goes to
+ */
+int *rhere() {
+	rlast = 0;
+	return text_p + 1;
+}
+
+int rtemp_new() {
+	if (++rtemp > rtemp_max)
+		rtemp_max = rtemp;
+	return -(rbase + rtemp);
+}
+
+/*
+ * rresult() - give back slot s from an expression entered with base
+ * temporaries in use, the ones up to s stay in use
+ */
+int rresult(int base, int s) {
+	rtemp = -s - rbase > base ? -s - rbase : base;
+	return s;
+}
+
+/*
+ * rword() - whether a local of type t fits its slot, so it can be used in
+ * place
+ */
+int rword(int t) {
+	return t != CHAR && (t >= PTR || t < type_builtin);
+}
+
+/*
+ * rset() - copy slot s to slot d, or let the instruction that just
+ * computed the temporary s write d instead
+ */
+void rset(int d, int s) {
+	if (s == d)
+		return;
+	if (rlast && rlast[1] == s && -s - rbase > 0 && (*rlast <= RLC || *rlast == RAX || *rlast >= ROR))
+		rlast[1] = d;
+	else
+		remit(RMOV, d, s, 0);
+}
+
+int rgen(int *n);
+
+void rgen_args(int *arg) {
+	int base;
+
+	if (!arg)
+		return;
+	rgen_args((int *) *arg);
+	base = rtemp;
+	remit(RARG, 0, rgen(arg + 1), 0);
+	rtemp = base;
+}
+
+/*
+ * rgen() - emit the register instructions which evaluate a tree, returns
+ * the slot that holds the value
+ *
+ * With rdiscard set the value of the tree isn't used.
+ */
+int rgen(int *n) {
+	int base, discard, op, i, a, b, d, *c, *j, *k;
+
+	if (text_p > text_limit)
+		err_exit("error - text segment overflow\n");
+	base = rtemp;
+	discard = rdiscard;
+	rdiscard = 0;
+	switch (*n) {
+	case Num:
+		remit(RLI, d = rtemp_new(), n[1], 0);
+		return d;
+	case Global:
+		remit(RLI, d = rtemp_new(), (n[1] ? ((struct ident *) n[1])->val : 0) + n[2], 0);
+		return d;
+	case Local:
+		remit(RLEA, d = rtemp_new(), n[1], 0);
+		return d;
+	case Load:
+		if ((i = konst_param(n)) >= 0) {
+			remit(RLI, d = rtemp_new(), n[1] == CHAR ? (char) cur_ir->konst[i] : cur_ir->konst[i], 0);
+			return d;
+		}
+		if (n[2] == Local && rword(n[1])) {
+			// with its address taken a call could change the local
+			// before the value is used, take a copy
+			if (!frame_escape)
+				return n[3];
+			remit(RMOV, d = rtemp_new(), n[3], 0);
+			return d;
+		}
+		a = rgen(n + 2);
+		// a struct is used through its address
+		if (n[1] != CHAR && !rword(n[1]))
+			return a;
+		rtemp = base;
+		remit(n[1] == CHAR ? RLC : RLW, d = rtemp_new(), a, 0);
+		return d;
+	case Assign:
+		c = (int *) n[2];
+		if (*c == Local && rword(n[1])) {
+			rset(c[1], rgen(n + 3));
+			rtemp = base;
+			if (!frame_escape || discard)
+				return c[1];
+			remit(RMOV, d = rtemp_new(), c[1], 0);
+			return d;
+		}
+		a = rgen(c);
+		b = rgen(n + 3);
+		if (n[1] == CHAR) {
+			remit(RSC, a, b, d = rtemp_new());
+			return d;
+		}
+		remit(RSW, a, b, 0);
+		return rresult(base, b);
+	case Inc:
+	case Dec:
+		i = n[1] >= PTR ? type_sizeof(n[1] - PTR) : 1;
+		op = *n == Inc ? RADDI : RSUBI;
+		c = n + 3;
+		if (*c == Local && rword(n[1])) {
+			if (n[2] && !discard) {
+				// postfix, give back the old value
+				remit(RMOV, d = rtemp_new(), c[1], 0);
+				remit(op, c[1], c[1], i);
+				return d;
+			}
+			remit(op, c[1], c[1], i);
+			if (!frame_escape || discard)
+				return c[1];
+			remit(RMOV, d = rtemp_new(), c[1], 0);
+			return d;
+		}
+		a = rgen(c);
+		remit(n[1] == CHAR ? RLC : RLW, b = rtemp_new(), a, 0);
+		remit(op, d = rtemp_new(), b, i);
+		if (n[1] == CHAR)
+			remit(RSC, a, d, d);
+		else
+			remit(RSW, a, d, 0);
+		// postfix gives back the stored value stepped back, as the
+		// stack form does
+		if (n[2]) {
+			b = rtemp_new();
+			remit(op == RADDI ? RSUBI : RADDI, b, d, i);
+			return b;
+		}
+		return d;
+	case Cond:
+		j = remit(RBZ, 0, rgen((int *) n[1]), 0);
+		rtemp = base;
+		d = rtemp_new();
+		rset(d, rgen((int *) n[2]));
+		k = remit(RJMP, 0, 0, 0);
+		j[1] = (int) rhere();
+		rtemp = base + 1;
+		rset(d, rgen(n + 3));
+		k[1] = (int) rhere();
+		return rresult(base, d);
+	case Lor:
+	case Lan:
+		// the result is normalized to 0 or 1
+		op = *n == Lor ? RBNZ : RBZ;
+		j = remit(op, 0, rgen((int *) n[1]), 0);
+		rtemp = base;
+		k = remit(op, 0, rgen(n + 2), 0);
+		rtemp = base;
+		remit(RLI, d = rtemp_new(), *n == Lan, 0);
+		c = remit(RJMP, 0, 0, 0);
+		j[1] = k[1] = (int) rhere();
+		remit(RLI, d, *n == Lor, 0);
+		c[1] = (int) rhere();
+		return d;
+	case Func:
+	case Syscall:
+		// the arguments go on the stack, the callee returns in ax
+		rgen_args((int *) n[1]);
+		d = 0;
+		if (*n == Syscall)
+			remit(RSYS, d = rtemp_new(), n[2], n[3]);
+		else {
+			*++text_p = RCALL;
+			gen_target((struct ident *) n[2]);
+			*++text_p = 0;
+			*++text_p = 0;
+			rlast = 0;
+		}
+		if (n[3])
+			remit(RADJ, n[3], 0, 0);
+		if (*n == Func && !discard)
+			remit(RAX, d = rtemp_new(), 0, 0);
+		return d;
+	default:
+		// binary operators map onto ROR..RMOD, a constant right operand
+		// onto RORI..RMODI
+		if (*n < Or || *n > Mod)
+			err_exit("error - unknown tree node\n");
+		a = rgen((int *) n[1]);
+		c = n + 2;
+		if (*c == Num) {
+			rtemp = base;
+			remit(RORI + *n - Or, d = rtemp_new(), a, c[1]);
+			return d;
+		}
+		b = rgen(c);
+		rtemp = base;
+		remit(ROR + *n - Or, d = rtemp_new(), a, b);
+		return d;
+	}
+}
+
+/*
+ * rstmt() - emit the register instructions of a statement tree
+ */
+void rstmt(int *n) {
+	int i, *a, *b, old_break, old_continue, old_switch, *old_default;
+
+	rtemp = 0;
+	switch (*n) {
+	case ';':
+		if (n[1])
+			rstmt((int *) n[1]);
+		break;
+	case '{':
+		rstmt((int *) n[1]);
+		rstmt(n + 2);
+		break;
+	case If:
+		a = remit(RBZ, 0, rgen((int *) n[1]), 0);
+		rstmt((int *) n[2]);
+		if (n[3]) {
+			b = remit(RJMP, 0, 0, 0);
+			a[1] = (int) rhere();
+			rstmt((int *) n[3]);
+			a = b;
+		}
+		a[1] = (int) rhere();
+		break;
+	case While:
+	case For:
+		// [While][cond][body]  /  [For][init][cond][step][body]
+		if (*n == For && n[1])
+			rstmt((int *) n[1]);
+		a = remit(RJMP, 0, 0, 0);
+		b = rhere();
+		old_break = break_cnt;
+		old_continue = continue_cnt;
+		rstmt((int *) n[*n == For ? 4 : 2]);
+		patch_jumps(continue_addr, old_continue, continue_cnt, rhere());
+		continue_cnt = old_continue;
+		if (*n == For && n[3])
+			rstmt((int *) n[3]);
+		a[1] = (int) rhere();
+		rtemp = 0;
+		if (*n == For && !n[2])
+			remit(RJMP, (int) b, 0, 0);
+		else
+			remit(RBNZ, (int) b, rgen((int *) n[*n == For ? 2 : 1]), 0);
+		patch_jumps(break_addr, old_break, break_cnt, rhere());
+		break_cnt = old_break;
+		break;
+	case DoWhile:
+		b = rhere();
+		old_break = break_cnt;
+		old_continue = continue_cnt;
+		rstmt((int *) n[2]);
+		patch_jumps(continue_addr, old_continue, continue_cnt, rhere());
+		continue_cnt = old_continue;
+		rtemp = 0;
+		remit(RBNZ, (int) b, rgen((int *) n[1]), 0);
+		patch_jumps(break_addr, old_break, break_cnt, rhere());
+		break_cnt = old_break;
+		break;
+	case Switch:
+		// [Switch][cond][body][slot]
+		rset(n[3], rgen((int *) n[1]));
+		a = remit(RJMP, 0, 0, 0);
+		old_break = break_cnt;
+		old_switch = switch_cnt;
+		old_default = default_addr;
+		default_addr = 0;
+		rstmt((int *) n[2]);
+		b = remit(RJMP, 0, 0, 0);
+		a[1] = (int) rhere();
+		for (i = old_switch; i < switch_cnt; i++) {
+			rtemp = 0;
+			remit(REQI, rtemp_new(), n[3], case_val[i]);
+			remit(RBNZ, case_addr[i], -(rbase + 1), 0);
+		}
+		a = remit(RJMP, 0, 0, 0);
+		a[1] = default_addr ? (int) default_addr : (int) rhere();
+		b[1] = (int) rhere();
+		patch_jumps(break_addr, old_break, break_cnt, rhere());
+		break_cnt = old_break;
+		switch_cnt = old_switch;
+		default_addr = old_default;
+		break;
+	case Case:
+		if (switch_cnt >= pool_size / sizeof(int))
+			err_exit("error - too many case labels\n");
+		case_val[switch_cnt] = n[1];
+		case_node[switch_cnt] = (int) n;
+		case_addr[switch_cnt++] = (int) rhere();
+		break;
+	case Default:
+		default_addr = rhere();
+		break;
+	case Break:
+	case Continue:
+		a = remit(RJMP, 0, 0, 0);
+		if (*n == Break) {
+			if (break_cnt >= pool_size / sizeof(int))
+				err_exit("error - too many break statements\n");
+			break_addr[break_cnt++] = (int) (a + 1);
+		}
+		else {
+			if (continue_cnt >= pool_size / sizeof(int))
+				err_exit("error - too many continue statements\n");
+			continue_addr[continue_cnt++] = (int) (a + 1);
+		}
+		break;
+	case Return:
+		if (n[1])
+			remit(RRET, 0, rgen((int *) n[1]), 0);
+		else
+			remit(RLEV, 0, 0, 0);
+		break;
+	default:
+		// an expression evaluated for its side effects
+		rdiscard = 1;
+		rgen(n);
+	}
+}
+
+/*
+ * rgen_func() - emit the register form of the function gen_func() set up
+ */
+void rgen_func(struct func_ir *f) {
+	int *a;
+
+	rbase = local_var_depth - idx_of_bp;
+	rtemp = rtemp_max = 0;
+	a = remit(RENT, 0, 0, 0);
+	if (f->body)
+		rstmt(f->body);
+	remit(RLEV, 0, 0, 0);
+	// the locals, then as many temporaries as the deepest expression took
+	a[1] = rbase + rtemp_max;
+}
+
+/*
+ * dump_text() - print the instructions in [from, to)
+ */
+// Opcode names, 4 characters each at op * 5
+char *op_names = "LEA ,LEAS,IMM ,IMMD,JMP ,CALL,BZ  ,BNZ ,ENT ,TAIL,VEC ,ADJ ,LEV ,RET ,LW  ,LC  ,SW  ,SC  ,PUSH,"
+		 "OR  ,XOR ,AND ,EQ  ,NEQ ,LT  ,GT  ,LE  ,GE  ,SHL ,SHR ,ADD ,SUB ,MUL ,DIV ,MOD ,"
+		 "OPEN,READ,CLOS,PRTF,FPRT,MALC,MSET,MCMP,EXIT,";
+
+// and of the register form
+char *rop_names = "LI  ,MOV ,LEA ,LW  ,LC  ,SW  ,SC  ,JMP ,BZ  ,BNZ ,ARG ,CALL,SYS ,ADJ ,ENT ,LEV ,RET ,AX  ,HALT,"
+		  "OR  ,XOR ,AND ,EQ  ,NEQ ,LT  ,GT  ,LE  ,GE  ,SHL ,SHR ,ADD ,SUB ,MUL ,DIV ,MOD ,"
+		  "ORI ,XORI,ANDI,EQI ,NEQI,LTI ,GTI ,LEI ,GEI ,SHLI,SHRI,ADDI,SUBI,MULI,DIVI,MODI,";
+
+void dump_text(int *from, int *to) {
+	for (; reg_vm && from < to; from += 4)
+		fprintf(ir_out, "\t%.4s %d %d %d\n", rop_names + *from * 5, from[1], from[2], from[3]);
+	while (from < to) {
+		fprintf(ir_out, "\t%.4s", op_names + *from * 5);
+		if (*from++ <= ADJ)
+			fprintf(ir_out, " %d", *from++);
+		fprintf(ir_out, "\n");
+	}
+}
+
+/*
+ * gen_body() - emit the stack form of the function gen_func() set up
+ */
+void gen_body(struct func_ir *f) {
+	int *a;
+
+	// a function without locals that calls nothing needs no frame, it
+	// addresses its parameters from sp
+	elide = !keep_frames && !func_calls && local_var_depth == idx_of_bp;
+	sp_depth = 0;
+	// the frame size is known once inlined calls have their temporaries
+	if (!elide) {
+		*++text_p = ENT;
+		a = ++text_p;
+	}
+	frame_max = local_var_depth;
+	if (f->body)
+		gen(f->body);
+	*++text_p = elide ? RET : LEV;
+	pgo_flush(0);
+	if (!elide)
+		*a = frame_max - idx_of_bp;
+	elide = 0;
+}
+
+/*
+ * gen_func() - emit the code of a parsed function
+ */
+void gen_func(struct func_ir *f) {
+	struct ident *func;
+	int *site, ev;
+
+	func = cur_func = f->id;
+	cur_ir = f;
+	idx_of_bp = f->params;
+	local_var_depth = f->frame;
+	func_calls = f->calls;
+	frame_escape = f->escape;
+	f->code = text_p + 1;
+	// a codegen thread emits to its own buffer, the code is placed later
+	if (!gen_threaded) {
+		func->val = (int) f->code;
+		while ((site = func->fixup)) {
+			func->fixup = (int *) *site;
+			*site = func->val;
+		}
+	}
+
+	ev = trace_begin("codegen", func->name, func->hash & 0x3f);
+	if (pgo_gen || pgo_use)
+		pgo_begin(f->body);
+	if (reg_vm)
+		rgen_func(f);
+	else
+		gen_body(f);
+	f->size = text_p + 1 - f->code;
+	trace_end(ev);
+
+	if (dump_ir && !gen_threaded) {
+		ev = trace_begin("dump_ir", func->name, func->hash & 0x3f);
+		dump_text((int *) func->val, text_p + 1);
+		trace_end(ev);
+	}
+}
+
+/*
+ * The threads of gen_funcs() take the next function to emit from
+ * gen_next until every one is taken.
+ */
+int gen_next;
+
+void *gen_thread(void *arg) {
+	struct func_ir *f;
+	int i, *buf;
+	jmp_buf env;
+
+	gen_threaded = 1;
+	trace_tid = (int) arg;
+	if (setjmp(env)) {
+		// the others stop too, the process ends with the error
+		__sync_fetch_and_add(&gen_next, func_cnt);
+		return 0;
+	}
+	gen_jmp = &env;
+	if (!(buf = malloc(pool_size)) || !(case_addr = malloc(pool_size)) || !(case_val = malloc(pool_size)) ||
+	    !(case_node = malloc(pool_size)) || !(break_addr = malloc(pool_size)) || !(continue_addr = malloc(pool_size)))
+		err_exit("error - couldn't malloc for a codegen thread\n");
+	text_p = buf;
+	text_limit = buf + pool_size / sizeof(int) - 64;
+	while ((i = __sync_fetch_and_add(&gen_next, 1)) < func_cnt) {
+		f = &funcs[i];
+		if (f->id->live)
+			gen_func(f);
+	}
+	free(case_addr);
+	free(case_val);
+	free(case_node);
+	free(break_addr);
+	free(continue_addr);
+	return buf;
+}
+
+/*
+ * gen_done() - give back the entries of emitted functions, except in a
+ * whole program which looks them up until the end
+ */
+void gen_done() {
+	struct func_ir *f;
+
+	if (whole_program)
+		return;
+	for (f = funcs; f < funcs + func_cnt; f++)
+		f->id->ir = 0;
+	func_cnt = 0;
+}
+
+/*
+ * gen_funcs() - emit the live functions that are parsed, in source order
+ *
+ * With --jobs the functions are emitted by that many threads, each into
+ * its own buffer. The code is then copied into text in source order, the
+ * jumps inside a function are moved with it and the calls are pointed at
+ * their callees.
+ */
+void gen_funcs() {
+	pthread_t *threads;
+	struct func_ir *f;
+	struct ident *d;
+	int **bufs, *c, delta, i, ev;
+
+	if (gen_jobs < 2) {
+		for (f = funcs; f < funcs + func_cnt; f++) {
+			if (f->id->live)
+				gen_func(f);
+		}
+		gen_done();
+		return;
+	}
+
+	threads = malloc(gen_jobs * sizeof(pthread_t));
+	bufs = malloc(gen_jobs * sizeof(int *));
+	if (!threads || !bufs)
+		err_exit("error - couldn't malloc for the codegen threads\n");
+	gen_next = 0;
+	*gen_err = 0;
+	for (i = 0; i < gen_jobs; i++) {
+		if (pthread_create(&threads[i], 0, gen_thread, (void *) (i + 1)))
+			err_exit("error - couldn't start a codegen thread\n");
+	}
+	for (i = 0; i < gen_jobs; i++)
+		pthread_join(threads[i], (void **) &bufs[i]);
+	if (*gen_err) {
+		line = gen_err_line;
+		err_exit(gen_err);
+	}
+
+	ev = trace_begin("link functions", 0, 0);
+	for (f = funcs; f < funcs + func_cnt; f++) {
+		if (f->id->live) {
+			if (text_p + f->size > text_limit)
+				err_exit("error - text segment overflow\n");
+			f->id->val = (int) (text_p + 1);
+			text_p += f->size;
+		}
+	}
+	for (f = funcs; f < funcs + func_cnt; f++) {
+		if (!f->id->live)
+			continue;
+		c = (int *) f->id->val;
+		memcpy(c, f->code, f->size * sizeof(int));
+		delta = (char *) c - (char *) f->code;
+		if (reg_vm) {
+			for (; c < (int *) f->id->val + f->size; c += 4) {
+				if (*c == RJMP || *c == RBZ || *c == RBNZ)
+					c[1] += delta;
+			}
+		}
+		for (; c < (int *) f->id->val + f->size; c++) {
+			if (*c == JMP || *c == BZ || *c == BNZ)
+				c[1] += delta;
+			if (*c <= ADJ)
+				c++;
+		}
+		c = (int *) f->id->val;
+		for (i = 0; i < f->nreloc; i++) {
+			d = (struct ident *) f->reloc[i * 2 + 1];
+			if (d->val)
+				c[f->reloc[i * 2]] = d->val;
+			else {
+				c[f->reloc[i * 2]] = (int) d->fixup;
+				d->fixup = c + f->reloc[i * 2];
+			}
+		}
+		free(f->reloc);
+		f->reloc = 0;
+		f->nreloc = 0;
+		if (dump_ir)
+			dump_text((int *) f->id->val, c + f->size);
+	}
+	trace_end(ev);
+
+	for (i = 0; i < gen_jobs; i++)
+		free(bufs[i]);
+	free(bufs);
+	free(threads);
+	gen_done();
+}
+
+/* 
+ * stmt() - parse a statement into a tree at ast_ptr
+ * 
+ * Statement trees:
+ *	[';'][expr or 0]		expression or empty statement
+ *	['{'][first] second		two statements in a row
+ *	[If][cond][then][else or 0]
+ *	[While][cond][body], [DoWhile][cond][body]
+ *	[For][init][cond][step][body]	missing parts are 0
+ *	[Switch][cond][body][slot]
+ *	[Case][value], [Default], [Break], [Continue]
+ *	[Return][expr or 0]
+ *
+ * stmt(Func) parses a function body into a func_ir and, unless the whole
+ * program is compiled at once, emits its code.
+ */
+void stmt(int target) {
+	int type, var_type;
+	int *a, *b, *c, *d;
+	struct func_ir *f;
+
+	switch (target) {
+	case Func:
+		local_var_depth = idx_of_bp;
+		match_token('{');
+		// parse local variables and other statements.
+		while (token == Int || token == Char || token == Struct || token == Union) {
+			type = INT;
+			switch(token) {
+				case Int:
+					next();
+					break;
+				case Char:
+					type = CHAR;
+					next();
+					break;
+				case Struct:
+				case Union:
+					next();
+					type = struct_tag();
+					break;
+			}
+
+			while (token != ';') {
+				var_type = type;
+				while (token == Mul) {
+					var_type += PTR;
+					next();
+				}
+				if (token != Id) 
+					err_exit("error - expected identifier\n");
+				if (var_type < PTR && var_type >= type_builtin && (!layouts[var_type].member || !decl_seen(layouts[var_type].seq)))
+					err_exit("error - variable has incomplete type\n");
+				// a struct is only ever used through its address
+				if (var_type < PTR && var_type >= type_builtin)
+					frame_escape = 1;
+				next();
+
+				id->hclass = id->class;
+				id->class = Local;
+				
+				id->htype = id->type;
+				id->type = var_type;
+
+				// a local takes as many slots as its type needs
+				id->hval = id->val;
+				local_var_depth += (type_sizeof(var_type) + sizeof(int) - 1) / sizeof(int);
+				id->val = local_var_depth;
+
+				if (token == ',')
+					next();
+			}
+			next();
+		}
+
+		b = 0;
+		while (token != '}') {
+			stmt(token);
+			if (b) {
+				*--ast_ptr = (int) b;
+				*--ast_ptr = '{';
+			}
+			b = ast_ptr;
+		}
+
+		// with a profile or the whole program, keep the tree of a function
+		// that only returns an expression so that calls can inline it
+		if ((pgo_use || whole_program) && b && *b == Return && b[1] && local_var_depth == idx_of_bp &&
+		    ast_top - ast_ptr < 64) {
+			*--ast_ptr = b[1];
+			*--ast_ptr = idx_of_bp;
+			cur_func->inline_tree = ast_ptr;
+		}
+
+		// calls with constant arguments can run a pure function while
+		// at most half the pool holds trees
+		if (b && ast_ptr - ast > pool_size / sizeof(int) / 2 && ce_pure(b)) {
+			*--ast_ptr = (int) b;
+			*--ast_ptr = local_var_depth;
+			*--ast_ptr = idx_of_bp;
+			cur_func->pure = ast_ptr;
+		}
+
+		if (func_cnt == pool_size / sizeof(struct func_ir))
+			err_exit("error - too many functions\n");
+		f = &funcs[func_cnt++];
+		memset(f, 0, sizeof(struct func_ir));
+		f->id = cur_func;
+		f->body = b;
+		f->params = idx_of_bp;
+		f->frame = local_var_depth;
+		f->calls = func_calls;
+		f->escape = frame_escape;
+		cur_func->ir = f;
+		// outside a whole program every function is emitted, with --jobs
+		// once the file is parsed
+		if (!whole_program)
+			cur_func->live = 1;
+		if (!whole_program && gen_jobs < 2)
+			gen_funcs();
+		break;
+	case '{':
+		next();
+		b = 0;
+		while (token != '}') {
+			stmt(token);
+			if (b) {
+				*--ast_ptr = (int) b;
+				*--ast_ptr = '{';
+			}
+			b = ast_ptr;
+		}
+		next();
+		if (!b) {
+			*--ast_ptr = 0;
+			*--ast_ptr = ';';
+		}
+		break;
+	case If:
+		next();
+		match_token('(');
+		expr(Assign);
+		a = ast_ptr;
+		match_token(')');
+		stmt(token);
+		b = ast_ptr;
+		c = 0;
+		if (token == Else) {
+			next();
+			stmt(token);
+			c = ast_ptr;
+		}
+		*--ast_ptr = (int) c;
+		*--ast_ptr = (int) b;
+		*--ast_ptr = (int) a;
+		*--ast_ptr = If;
+		break;
+	case While:
+		next();
+		match_token('(');
+		expr(Assign);
+		a = ast_ptr;
+		match_token(')');
+		++loop_depth;
+		stmt(token);
+		--loop_depth;
+		b = ast_ptr;
+		*--ast_ptr = (int) b;
+		*--ast_ptr = (int) a;
+		*--ast_ptr = While;
+		break;
+	case DoWhile:
+		next();
+		++loop_depth;
+		stmt(token);
+		--loop_depth;
+		b = ast_ptr;
+		match_token(While);
+		match_token('(');
+		expr(Assign);
+		a = ast_ptr;
+		match_token(')');	
+		match_token(';');
+		*--ast_ptr = (int) b;
+		*--ast_ptr = (int) a;
+		*--ast_ptr = DoWhile;
+		break;
+	case For:
+		next();
+		match_token('(');
+		a = b = c = 0;
+		if (token != ';') {
+			expr(Assign);
+			a = ast_ptr;
+		}
+		match_token(';');
+		if (token != ';') {
+			expr(Assign);
+			b = ast_ptr;
+		}
+		match_token(';');
+		if (token != ')') {
+			expr(Assign);
+			c = ast_ptr;
+		}
+		match_token(')');
+		++loop_depth;
+		stmt(token);
+		--loop_depth;
+		d = ast_ptr;
+		*--ast_ptr = (int) d;
+		*--ast_ptr = (int) c;
+		*--ast_ptr = (int) b;
+		*--ast_ptr = (int) a;
+		*--ast_ptr = For;
+		break;
+	case Switch:
+		next();
+		match_token('(');
+		expr(Assign);
+		a = ast_ptr;
+		match_token(')');
+		++switch_depth;
+		stmt(token);
+		--switch_depth;
+		b = ast_ptr;
+		*--ast_ptr = idx_of_bp - ++local_var_depth;
+		*--ast_ptr = (int) b;
+		*--ast_ptr = (int) a;
+		*--ast_ptr = Switch;
+		break;
+	case Case:
+		next();
+		if (!switch_depth)
+			err_exit("error - case label not within a switch\n");
+		expr(Cond);
+		if (*ast_ptr != Num)
+			err_exit("error - case label is not a constant\n");
+		match_token(':');
+		*ast_ptr = Case;
+		break;
+	case Default:
+		next();
+		if (!switch_depth)
+			err_exit("error - default label not within a switch\n");
+		match_token(':');
+		*--ast_ptr = Default;
+		break;
+	case Break:
+	case Continue:
+		next();
+		if (target == Break ? !loop_depth && !switch_depth : !loop_depth)
+			err_exit("error - break/continue not within a loop\n");
+		match_token(';');
+		*--ast_ptr = target;
+		break;
+	case Return:
+		next();
+		a = 0;
+		if (token != ';') {
+			expr(Assign);
+			a = ast_ptr;
+		}
+		match_token(';');
+		*--ast_ptr = (int) a;
+		*--ast_ptr = Return;
+		break;
+	case ';':
+		next();
+		*--ast_ptr = 0;
+		*--ast_ptr = ';';
+		break;
+	case Goto:
+		err_exit("error - goto is not supported\n");
+	default:
+		expr(Assign);
+		a = ast_ptr;
+		match_token(';');
+		*--ast_ptr = (int) a;
+		*--ast_ptr = ';';
+		break;
+	}
+}
+
+/*
+ * struct_index() - build the name index of the members of l
+ */
+void struct_index(struct struct_layout *l) {
+	int i, j;
+
+	// the name index is at most half full
+	for (l->index_mask = 1; l->index_mask < 2 * l->count; l->index_mask <<= 1)
+		;
+	l->index = malloc(l->index_mask * sizeof(int));
+	memset(l->index, -1, l->index_mask * sizeof(int));
+	--l->index_mask;
+	for (i = 0; i < l->count; i++) {
+		for (j = l->member[i].id->hash & l->index_mask; l->index[j] >= 0; j = (j + 1) & l->index_mask) {
+			if (l->member[l->index[j]].id == l->member[i].id)
+				err_exit("error - duplicate member\n");
+		}
+		l->index[j] = i;
+	}
+}
+
+/*
+ * struct_body() - parse the members of a struct or union and lay it out
+ *
+ * Every member is placed at its natural alignment, all members of a union
+ * start at offset 0, and the size is padded to a multiple of the strictest
+ * member alignment so the type can be used in arrays.
+ */
+void struct_body(int type, int is_union) {
+	struct struct_layout *l, def;
+	struct struct_member *m;
+	int base_type, member_type;
+	int offset, size, align, max_align;
+	int cap, i;
+
+	// another file of the whole program, or a module the unit links, may
+	// have defined it already, it is parsed again and compared below
+	l = &layouts[type];
+	if (l->member && l->tu >= 0 && (!whole_program || l->tu == tu_index))
+		err_exit("error - duplicate structure definition\n");
+	cap = 8;
+	def.member = malloc(cap * sizeof(struct struct_member));
+	def.count = 0;
+	offset = size = 0;
+	max_align = 1;
+
+	match_token('{');
+	while (token != '}') {
+		base_type = INT;
+		switch (token) {
+		case Int:
+			next();
+			break;
+		case Char:
+			next();
+			base_type = CHAR;
+			break;
+		case Struct:
+		case Union:
+			next();
+			base_type = struct_tag();
+			break;
+		default:
+			err_exit("error - bad member declaration\n");
+		}
+
+		while (token != ';') {
+			member_type = base_type;
+			while (token == Mul) {
+				member_type += PTR;
+				next();
+			}
+			if (token != Id)
+				err_exit("error - expected identifier\n");
+			if (member_type < PTR && member_type >= type_builtin && (member_type == type || !layouts[member_type].member))
+				err_exit("error - member has incomplete type\n");
+
+			if (def.count == cap)
+				def.member = realloc(def.member, (cap *= 2) * sizeof(struct struct_member));
+			m = &def.member[def.count++];
+			m->id = id;
+			m->type = member_type;
+
+			align = type_alignof(member_type);
+			if (align > max_align)
+				max_align = align;
+			if (is_union) {
+				m->offset = 0;
+				if (type_sizeof(member_type) > size)
+					size = type_sizeof(member_type);
+			}
+			else {
+				offset = (offset + align - 1) & -align;
+				m->offset = offset;
+				offset = size = offset + type_sizeof(member_type);
+			}
+
+			next();
+			if (token == ',')
+				next();
+			else if (token != ';')
+				err_exit("error - expected ; after member\n");
+		}
+		next();
+	}
+	next();
+	size = (size + max_align - 1) & -max_align;
+
+	if (l->member) {
+		// the same members with the same types in the same places
+		for (i = 0; i < def.count && i < l->count; i++) {
+			if (def.member[i].id != l->member[i].id || def.member[i].type != l->member[i].type ||
+			    def.member[i].offset != l->member[i].offset)
+				break;
+		}
+		free(def.member);
+		if (i < def.count || i < l->count || size != type_size[type] || max_align != type_align[type])
+			err_exit("error - conflicting structure definition\n");
+		return;
+	}
+	l->member = def.member;
+	l->count = def.count;
+	l->tu = tu_index;
+	l->seq = ++decl_seq;
+	type_align[type] = max_align;
+	type_size[type] = size;
+	struct_index(l);
+}
+
+/* 
+ * parse_global_decl() - parse global variables, functions and composite data types
+ * 
+ * It should parse the source code matching the following form.
+ * 	(...) means function parameters.
+ *	{...} means function definition or composite data types definition.
+ *
+ * 
+ * variable:
+ * 	<type> [*] <id> [ = (<expr> | {...})] ;
+ *
+ *		int a = 10;
+ *		int aa;
+ *		int *b;
+ *		char **c;
+ *
+ * function:
+ * 	<type> [*] <id> (...) {...}
+ *
+ * 		void foo() {...}
+ *		int func(int k) {...}
+ *
+ *		after getting '(', it should start ...
+ *			1. parse function parameters.
+ *			2. parse function definition. (local variables and statements)
+ *				
+ * enum:
+ * 	enum [<id>] {...} ;
+ * 
+ * struct:
+ *	struct <id> {...} ;
+ *
+ * union:
+ *	union <id> {...} ;
+ */
+/*
+ * skip_body() - skip the rest of a block whose '{' was just read, up to
+ * the '}' that closes it
+ *
+ * Braces in string and character literals, comments and macro lines
+ * don't count. Nothing is looked up or stored, so a skipped function
+ * only costs one pass over its text.
+ */
+void skip_body() {
+	int depth, c;
+
+	depth = 1;
+	while ((c = *p++)) {
+		switch (c) {
+		case '{':
+			++depth;
+			break;
+		case '}':
+			if (!--depth) {
+				token = '}';
+				last_p = p;
+				return;
+			}
+			break;
+		case '\n':
+			++line;
+			break;
+		case '"':
+		case '\'':
+			while (*p && *p != c) {
+				if (*p == '\\' && p[1])
+					++p;
+				if (*p == '\n')
+					++line;
+				++p;
+			}
+			if (*p)
+				++p;
+			break;
+		case '/':
+			if (*p == '/' || *p == '*') {
+				c = *p++;
+				while (*p && (c == '/' ? *p != '\n' : *p != '*' || p[1] != '/')) {
+					if (*p == '\n')
+						++line;
+					++p;
+				}
+				if (c == '*' && *p)
+					p += 2;
+			}
+			break;
+		case '#':
+			while (*p && *p != '\n')
+				++p;
+			break;
+		}
+	}
+	err_exit("error - unterminated function body\n");
+}
+
+/*
+ * func_decl() - parse the parameters and the body or ';' of function func
+ *
+ * The parameters are locals until the declaration ends. token is the
+ * '(' that follows the name.
+ */
+void func_decl(struct ident *func) {
+	struct ident *d;
+	char *start;
+	int type, params, ev, start_line;
+
+	start = p - 1;
+	start_line = line;
+	func_calls = frame_escape = 0;
+	// parse parameters
+	next();
+	params = 0;
+	while (token != ')') {
+		type = INT;
+		switch (token) {
+		case Int:
+			next();
+			break;
+		case Char:
+			next();
+			type = CHAR;
+			break;
+		case Struct:
+		case Union:
+			next();
+			type = struct_tag();
+			break;
+		}
+		
+		while (token == Mul) {
+			type = type + PTR;
+			next();
+		}
+		if (type < PTR && type >= type_builtin)
+			frame_escape = 1;
+
+		// (void) declares an empty parameter list
+		if (token == ')' && !params)
+			break;
+
+		if (token != Id) {
+			err_exit("error - bad parameter declaration\n");
+		}
+
+		if (id->class == Local) {
+			err_exit("error - duplicate parameter declaration\n");
+		}
+
+		if (token != Id) 
+			err_exit("error - expected identifier");
+
+		id->hclass = id->class;
+		id->class = Local;
+
+		id->htype = id->type;
+		id->type = type;
+		
+		id->hval = id->val;
+		id->val = params++;
+
+		next();
+		if (token == ',')
+			match_token(',');
+	}
+	idx_of_bp = params + 1;
+	next();
+
+	// a prototype only declares the function
+	if (token != ';') {
+		if (func->ir || func->val || func->lazy)
+			err_exit("error - redefinition of a function\n");
+
+		old_text = text_p;
+
+		// with --lazy only the functions main() reaches are parsed
+		if (lazy_bodies && !lazy_pass && func != id_main) {
+			func->lazy = start;
+			func->lazy_line = start_line;
+			func->lazy_seq = decl_seq;
+			skip_body();
+		}
+		else {
+			ev = trace_begin("function body", func->name, func->hash & 0x3f);
+			cur_func = func;
+			stmt(Func);
+			trace_end(ev);
+			// nothing refers to the trees of a finished function, unless
+			// it can be inlined or it is still to be emitted
+			if (func->inline_tree || func->pure || whole_program || gen_jobs > 1)
+				ast_top = ast_ptr;
+			// the codegen threads take the parsed functions once their
+			// trees fill three quarters of the pool
+			if (gen_jobs > 1 && !whole_program && ast_top - ast < pool_size / sizeof(int) / 4) {
+				gen_funcs();
+				ast_top = (int *) ((int) ast + pool_size);
+				for (d = sym_user; d->token; d++)
+					d->pure = 0;
+			}
+			ast_ptr = ast_top;
+		}
+	}
+	id = sym;
+
+	// clear id table for local variable and label
+	while (id->token) {
+		if (id->class == Local) {
+			id->class = id->hclass;
+			id->type = id->htype;
+			id->val = id->hval;
+		}
+		else if (id->class == Label) {
+			id->class = 0;
+			id->type = 0;
+			id->val = 0;
+		}
+		id++;
+	}
+}
+
+/*
+ * alloc_global() - place a global variable in .bss
+ */
+void alloc_global(struct ident *d) {
+	int i;
+
+	i = type_alignof(d->type);
+	if (i > bss_align)
+		bss_align = i;
+	bss_p = (char *) (((int) bss_p + i - 1) & -i);
+	d->val = (int) bss_p;
+	if (type_sizeof(d->type) > bss + pool_size - bss_p)
+		err_exit("error - bss section overflow\n");
+	bss_p = bss_p + type_sizeof(d->type);
+}
+
+void parse_global_decl() {
+	int i;
+	int type;
+	int idx_of_locvar;
+	int decl_type;
+	int struct_token;
+	struct ident *func;
+
+	decl_type = INT;
+
+	switch (token) {
+	case Enum:
+		next();
+		if (token != '{') {
+			if (token != Id) 
+				err_exit("error - expected identifier");
+		}
+		if (token == '{') {
+			next();
+			i = 0;
+			while(token != '}') {
+				if (token != Id) {
+					err_exit("error - bad enum identifier\n");
+				}
+				next();
+				if (token == Assign) {
+					// TODO: parse a string literal or an expression.
+					next();
+					// expr()
+					if (token != Num) {
+						err_exit("error - bad enum initializer\n");
+					}
+					i = token_num;
+					next();
+				}
+				id->class = Num;
+				id->type = INT;
+				id->val = i++;
+				id->seq = ++decl_seq;
+				
+				match_token(',');
+			}
+			next();
+
+		}
+
+		match_token(';');
+		return;
+	case Int:
+	case Char:
+	case Struct:
+	case Union:
+		type = token;
+		switch(token) {
+		case Struct:
+		case Union:
+			struct_token = token;
+			next();
+			decl_type = struct_tag();
+			if (token == '{')
+				struct_body(decl_type, struct_token == Union);
+			break;
+		case Int:
+		case Char:
+			decl_type = (token == Int) ? INT : CHAR;
+			next();
+			break;
+		}
+
+		if ((type == Int || type == Char) && token == ';') {
+			err_exit("bad global declaration\n");
+		}
+		
+		while (token != ';' && token != '}') {
+			expr_type = decl_type;
+			while (token == Mul) {
+				expr_type = expr_type + PTR;
+				next();
+			}
+
+			if (token != Id) {
+				err_exit("error - expected identifier\n");
+			}
+			next();
+
+			if (token == '(') {
+				func = id;
+				func->class = Func;
+				func->type = expr_type;
+				if (!func->seq)
+					func->seq = ++decl_seq;
+				func_decl(func);
+			}
+			else {
+				if (expr_type < PTR && expr_type >= type_builtin && !layouts[expr_type].member)
+					err_exit("error - variable has incomplete type\n");
+				// the files of a whole program share their globals, and a
+				// unit can declare the globals of the modules it links
+				if ((whole_program || id->val < (int) mod_bss_end) && id->class == Global) {
+					if (id->type != expr_type)
+						err_exit("error - conflicting types for a global\n");
+				}
+				else {
+					id->class = Global;
+					id->type = expr_type;
+					if (!whole_program)
+						alloc_global(id);
+				}
+				if (!id->seq)
+					id->seq = ++decl_seq;
+				if (token == ',')
+					match_token(',');
+
+			}
+		}
+	}
+	next();
+}
+
+/*
+ * parse_lazy() - parse the skipped bodies of the functions that parsed code
+ * calls, until no call leads to a skipped body
+ *
+ * Without a main() every function is kept, so every body is parsed.
+ */
+void parse_lazy() {
+	struct ident *d;
+	int more, old_line;
+
+	old_line = line;
+	lazy_pass = 1;
+	do {
+		more = 0;
+		for (d = sym_user; d->token; d++) {
+			if (d->class == Func && d->lazy && (d->used || !(id_main->ir || id_main->val))) {
+				p = last_p = d->lazy;
+				line = d->lazy_line;
+				lazy_limit = d->lazy_seq;
+				d->lazy = 0;
+				next();
+				func_decl(d);
+				more = 1;
+			}
+		}
+	} while (more);
+	lazy_pass = 0;
+	line = old_line;
+}
+
+/*
+ * resolve_calls() - check that every function that is called is defined
+ */
+void resolve_calls() {
+	char errstr[128];
+	int ev;
+
+	ev = trace_begin("resolve calls", 0, 0);
+	for (id = sym_user; id->token; id++) {
+		if (id->class == Func && !id->val && id->fixup) {
+			sprintf(errstr, "error - undefined function %.*s\n", id->hash & 0x3f, id->name);
+			err_exit(errstr);
+		}
+	}
+	trace_end(ev);
+}
+
+void program() {
+	char errstr[128];
+	int ev;
+
+	next();
+	while (token > 0) {
+		sprintf(errstr, "line %d", line);
+		ev = trace_begin("parse_global_decl", errstr, -1);
+		parse_global_decl();
+		trace_end(ev);
+	}
+
+	// a whole program is emitted once all of its files are parsed
+	if (whole_program)
+		return;
+	if (lazy_bodies)
+		parse_lazy();
+	if (gen_jobs > 1)
+		gen_funcs();
+	resolve_calls();
+}
+
+/*
+ * wp_meet() - merge the argument tree a of a call into parameter k of f,
+ * a null tree is an argument that is not known
+ */
+void wp_meet(struct func_ir *f, int k, int *a) {
+	if (k >= WP_PARAMS || f->kstate[k] == 2)
+		return;
+	if (!a || *a != Num || (f->kstate[k] && f->konst[k] != a[1]))
+		f->kstate[k] = 2;
+	else {
+		f->kstate[k] = 1;
+		f->konst[k] = a[1];
+	}
+}
+
+/*
+ * wp_walk() - find what the tree n of function f uses
+ *
+ * The functions it calls and the globals it names become live, the
+ * arguments of its calls meet the parameters of the callees, and the
+ * parameters it assigns vary. Calls that gen() will inline are followed
+ * into the inlined expression instead.
+ */
+void wp_walk(int *n, struct func_ir *f) {
+	int *a, k;
+	struct ident *d;
+
+	if (!n)
+		return;
+	switch (*n) {
+	case Num:
+	case Local:
+	case Break:
+	case Continue:
+	case Case:
+	case Default:
+		break;
+	case Global:
+		if (n[1])
+			((struct ident *) n[1])->live = 1;
+		break;
+	case Load:
+		wp_walk(n + 2, f);
+		break;
+	case Assign:
+	case Inc:
+	case Dec:
+		a = *n == Assign ? (int *) n[2] : n + 3;
+		if (*a == Local && (k = f->params - a[1]) >= 0 && k < WP_PARAMS)
+			f->kstate[k] = 2;
+		wp_walk(a, f);
+		if (*n == Assign)
+			wp_walk(n + 3, f);
+		break;
+	case Cond:
+	case If:
+		wp_walk((int *) n[1], f);
+		wp_walk((int *) n[2], f);
+		wp_walk(*n == Cond ? n + 3 : (int *) n[3], f);
+		break;
+	case Func:
+	case Syscall:
+		for (a = (int *) n[1]; a; a = (int *) *a)
+			wp_walk(a + 1, f);
+		if (*n == Syscall)
+			break;
+		d = (struct ident *) n[2];
+		if (inline_call(n)) {
+			++inline_depth;
+			wp_walk((int *) d->inline_tree[1], d->ir);
+			--inline_depth;
+			break;
+		}
+		// an undefined function is reported once the code is emitted
+		if (!d->ir)
+			break;
+		d->live = 1;
+		if (n[3] != d->ir->params - 1) {
+			for (k = 0; k < WP_PARAMS; k++)
+				d->ir->kstate[k] = 2;
+			break;
+		}
+		// the arguments are linked from the last one
+		k = n[3];
+		for (a = (int *) n[1]; a; a = (int *) *a)
+			wp_meet(d->ir, --k, a + 1);
+		break;
+	case ';':
+	case Return:
+		wp_walk((int *) n[1], f);
+		break;
+	case While:
+	case DoWhile:
+	case Switch:
+		wp_walk((int *) n[1], f);
+		wp_walk((int *) n[2], f);
+		break;
+	case For:
+		wp_walk((int *) n[1], f);
+		wp_walk((int *) n[2], f);
+		wp_walk((int *) n[3], f);
+		wp_walk((int *) n[4], f);
+		break;
+	default:
+		// '{' and the binary operators
+		wp_walk((int *) n[1], f);
+		wp_walk(n + 2, f);
+	}
+}
+
+/*
+ * wp_emit() - optimize and emit a whole program once all its files are parsed
+ *
+ * Only what main() can reach is kept: functions that are never called and
+ * globals that no live code names get neither code nor data. A parameter
+ * that every call passes the same constant becomes that constant in the
+ * callee, and small functions are inlined across files.
+ */
+void wp_emit() {
+	struct func_ir *f;
+	int k, more, ev;
+
+	ev = trace_begin("whole program", 0, 0);
+	// without a main() nothing can be dropped
+	for (f = funcs; f < funcs + func_cnt; f++) {
+		if (!id_main->ir || f == id_main->ir) {
+			f->id->live = 1;
+			for (k = 0; k < WP_PARAMS; k++)
+				f->kstate[k] = 2;
+		}
+	}
+	do {
+		more = 0;
+		for (f = funcs; f < funcs + func_cnt; f++) {
+			if (f->id->live && !f->walked) {
+				f->walked = more = 1;
+				cur_func = f->id;
+				wp_walk(f->body, f);
+			}
+		}
+	} while (more);
+
+	// a parameter whose address is taken may change behind our back
+	for (f = funcs; f < funcs + func_cnt; f++) {
+		if (f->escape) {
+			for (k = 0; k < WP_PARAMS; k++)
+				f->kstate[k] = 2;
+		}
+	}
+	for (id = sym_user; id->token; id++) {
+		if (id->class == Global && id->live)
+			alloc_global(id);
+	}
+	trace_end(ev);
+
+	gen_funcs();
+	resolve_calls();
+}
+
+/*
+ * The --profile state. Every function of the program has a prof_func, in
+ * the order of their code. The calling context tree has a node per distinct
+ * call stack, node 0 stands for the startup stub that calls main(). Every
+ * instruction is attributed to its opcode and to the node of the current
+ * call stack; CALL and LEV move between nodes.
+ */
+struct prof_func {
+	struct ident *id;
+	int start;
+	int self;
+	int total;
+	int calls;
+	int active;
+} *prof_funcs;
+int prof_nfuncs;
+
+struct prof_node {
+	int func;
+	int parent;
+	int child;
+	int sibling;
+	int depth;
+	int self;
+	int calls;
+	int entry;
+} *prof_nodes;
+int prof_nnodes, prof_max, prof_cur;
+int prof_ops[EXIT + 1];
+
+int prof_by_start(const void *a, const void *b) {
+	return ((struct prof_func *) a)->start - ((struct prof_func *) b)->start;
+}
+
+void profile_init() {
+	struct ident *i;
+
+	prof_nfuncs = 0;
+	// main() is seeded with the keywords, in front of sym_user
+	for (i = sym; i->token; i++)
+		if (i->class == Func && i->val)
+			prof_nfuncs++;
+	if (!(prof_funcs = realloc(prof_funcs, (prof_nfuncs + 1) * sizeof(struct prof_func))))
+		err_exit("could not malloc for the profile\n");
+	memset(prof_funcs, 0, (prof_nfuncs + 1) * sizeof(struct prof_func));
+	prof_nfuncs = 0;
+	for (i = sym; i->token; i++) {
+		if (i->class == Func && i->val) {
+			prof_funcs[prof_nfuncs].id = i;
+			prof_funcs[prof_nfuncs++].start = i->val;
+		}
+	}
+	qsort(prof_funcs, prof_nfuncs, sizeof(struct prof_func), prof_by_start);
+
+	prof_max = 1024;
+	if (!(prof_nodes = realloc(prof_nodes, prof_max * sizeof(struct prof_node))))
+		err_exit("could not malloc for the profile\n");
+	memset(prof_nodes, 0, sizeof(struct prof_node));
+	prof_nodes->func = -1;
+	prof_nnodes = 1;
+	prof_cur = 0;
+	memset(prof_ops, 0, sizeof(prof_ops));
+}
+
+/*
+ * profile_call() - enter the function whose code contains addr
+ */
+void profile_call(int addr) {
+	int lo, hi, mid, n;
+
+	lo = 0;
+	hi = prof_nfuncs - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (prof_funcs[mid].start <= addr)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	for (n = prof_nodes[prof_cur].child; n && prof_nodes[n].func != lo; n = prof_nodes[n].sibling)
+		;
+	if (!n) {
+		if (prof_nnodes == prof_max) {
+			prof_max = prof_max * 2;
+			if (!(prof_nodes = realloc(prof_nodes, prof_max * sizeof(struct prof_node))))
+				err_exit("could not malloc for the profile\n");
+		}
+		n = prof_nnodes++;
+		memset(&prof_nodes[n], 0, sizeof(struct prof_node));
+		prof_nodes[n].func = lo;
+		prof_nodes[n].parent = prof_cur;
+		prof_nodes[n].depth = prof_nodes[prof_cur].depth + 1;
+		prof_nodes[n].sibling = prof_nodes[prof_cur].child;
+		prof_nodes[prof_cur].child = n;
+	}
+	prof_nodes[n].calls++;
+	prof_nodes[n].entry = cycle;
+	prof_funcs[lo].calls++;
+	prof_funcs[lo].active++;
+	prof_cur = n;
+}
+
+void profile_return() {
+	struct prof_func *f;
+
+	if (!prof_cur)
+		return;
+	// recursive activations are already inside the outermost one
+	f = &prof_funcs[prof_nodes[prof_cur].func];
+	if (!--f->active)
+		f->total += cycle - prof_nodes[prof_cur].entry;
+	prof_cur = prof_nodes[prof_cur].parent;
+}
+
+int prof_by_self(const void *a, const void *b) {
+	return ((struct prof_func *) b)->self - ((struct prof_func *) a)->self;
+}
+
+/*
+ * profile_report() - print the flat profile and write the collapsed stacks
+ *
+ * The flat profile goes to stderr: instructions per function, with and
+ * without its callees, the call edges and the instructions per opcode.
+ * The collapsed stacks ("main;f;g <count>" per line) go to the file named
+ * by --profile, ready for flamegraph.pl and speedscope.
+ */
+void profile_report() {
+	FILE *f;
+	struct prof_func *sorted;
+	int *path, *edge, nedge, i, j, n, total;
+
+	while (prof_cur)
+		profile_return();
+	for (n = 1; n < prof_nnodes; n++)
+		prof_funcs[prof_nodes[n].func].self += prof_nodes[n].self;
+
+	if (!(f = fopen(profile, "w"))) {
+		fprintf(stderr, "error - couldn't write the profile %s\n", profile);
+	} else {
+		path = malloc(prof_nnodes * sizeof(int));
+		for (n = 1; n < prof_nnodes; n++) {
+			if (!prof_nodes[n].self)
+				continue;
+			for (i = n, j = 0; i; i = prof_nodes[i].parent)
+				path[j++] = prof_nodes[i].func;
+			while (j--) {
+				i = prof_funcs[path[j]].id->hash & 0x3f;
+				fprintf(f, "%.*s%s", i, prof_funcs[path[j]].id->name, j ? ";" : " ");
+			}
+			fprintf(f, "%d\n", prof_nodes[n].self);
+		}
+		fclose(f);
+		free(path);
+	}
+
+	// call edges, summed over the nodes of the same caller and callee
+	edge = malloc(prof_nnodes * 3 * sizeof(int));
+	nedge = 0;
+	for (n = 1; n < prof_nnodes; n++) {
+		for (i = 0; i < nedge; i++)
+			if (edge[i * 3] == prof_nodes[prof_nodes[n].parent].func && edge[i * 3 + 1] == prof_nodes[n].func)
+				break;
+		if (i == nedge) {
+			edge[i * 3] = prof_nodes[prof_nodes[n].parent].func;
+			edge[i * 3 + 1] = prof_nodes[n].func;
+			edge[i * 3 + 2] = 0;
+			nedge++;
+		}
+		edge[i * 3 + 2] += prof_nodes[n].calls;
+	}
+
+	total = cycle ? cycle : 1;
+	fprintf(stderr, "flat profile: %d instructions\n", cycle);
+	fprintf(stderr, "%7s %12s %12s %10s  %s\n", "self%", "self", "total", "calls", "function");
+	sorted = malloc((prof_nfuncs + 1) * sizeof(struct prof_func));
+	memcpy(sorted, prof_funcs, prof_nfuncs * sizeof(struct prof_func));
+	qsort(sorted, prof_nfuncs, sizeof(struct prof_func), prof_by_self);
+	for (i = 0; i < prof_nfuncs && sorted[i].calls; i++)
+		fprintf(stderr, "%6d%% %12d %12d %10d  %.*s\n", (int) (sorted[i].self * 100LL / total),
+			sorted[i].self, sorted[i].total, sorted[i].calls, sorted[i].id->hash & 0x3f, sorted[i].id->name);
+	free(sorted);
+	for (i = 0; i < nedge; i++) {
+		fprintf(stderr, "%s%10d  %.*s -> %.*s\n", i ? "" : "call edges:\n", edge[i * 3 + 2],
+			edge[i * 3] < 0 ? 5 : prof_funcs[edge[i * 3]].id->hash & 0x3f,
+			edge[i * 3] < 0 ? "start" : prof_funcs[edge[i * 3]].id->name,
+			prof_funcs[edge[i * 3 + 1]].id->hash & 0x3f, prof_funcs[edge[i * 3 + 1]].id->name);
+	}
+	free(edge);
+	fprintf(stderr, "opcodes:\n");
+	for (i = 0; i <= EXIT; i++)
+		if (prof_ops[i])
+			fprintf(stderr, "%10d  %.4s\n", prof_ops[i], op_names + i * 5);
+}
+
+/*
+ * The VM runtime. A program can't free what MALC gives it, so MALC bumps a
+ * pointer through arenas of VM_ARENA bytes, blocks over VM_BIG get their
+ * own, and all of them go when the next program runs. What a program
+ * prints to stdout is collected in vm_out and written in large writes:
+ * when it is full, before the program reads or prints to stderr, and when
+ * it exits. MSET and MCMP are the C library's, which is vectorized.
+ */
+enum {VM_ARENA = 1 << 20, VM_BIG = 1 << 14, VM_OUT = 1 << 16};
+// the blocks MALC took from the C library, linked through their first word
+char *vm_blocks, *vm_arena_p, *vm_arena_end;
+char vm_out[VM_OUT];
+int vm_out_len;
+
+/*
+ * vm_flush() - write what the program printed to stdout
+ */
+void vm_flush() {
+	int i, n;
+
+	for (i = 0; i < vm_out_len; i += n)
+		if ((n = write(1, vm_out + i, vm_out_len - i)) <= 0)
+			break;
+	vm_out_len = 0;
+}
+
+/*
+ * vm_block() - take a block of size bytes from the C library
+ */
+char *vm_block(int size) {
+	char *b;
+
+	if (!(b = malloc(size + 8)))
+		return 0;
+	*(char **) b = vm_blocks;
+	vm_blocks = b;
+	return b + 8;
+}
+
+/*
+ * vm_reset() - give back the blocks of the last program
+ */
+void vm_reset() {
+	char *b;
+
+	while ((b = vm_blocks)) {
+		vm_blocks = *(char **) b;
+		free(b);
+	}
+	vm_arena_p = vm_arena_end = 0;
+	vm_out_len = 0;
+}
+
+/*
+ * vm_malloc() - MALC, 8 byte aligned
+ */
+char *vm_malloc(int size) {
+	char *p;
+
+	if (size < 0)
+		return 0;
+	size = (size + 7) & -8;
+	if (size > VM_BIG)
+		return vm_block(size);
+	if (size > vm_arena_end - vm_arena_p) {
+		if (!(vm_arena_p = vm_block(VM_ARENA)))
+			return 0;
+		vm_arena_end = vm_arena_p + VM_ARENA;
+	}
+	p = vm_arena_p;
+	vm_arena_p += size;
+	return p;
+}
+
+/*
+ * vm_print() - PRTF and FPRT, with the values after fmt below t
+ */
+int vm_print(int fd, char *fmt, int *t) {
+	int n;
+
+	if (fd == 2) {
+		vm_flush();
+		return fprintf(stderr, fmt, t[-1], t[-2], t[-3], t[-4], t[-5]);
+	}
+	n = snprintf(vm_out + vm_out_len, VM_OUT - vm_out_len, fmt, t[-1], t[-2], t[-3], t[-4], t[-5]);
+	if (n >= VM_OUT - vm_out_len) {
+		vm_flush();
+		// more than the buffer holds goes out on its own
+		if (n >= VM_OUT)
+			return dprintf(1, fmt, t[-1], t[-2], t[-3], t[-4], t[-5]);
+		n = snprintf(vm_out, VM_OUT, fmt, t[-1], t[-2], t[-3], t[-4], t[-5]);
+	}
+	if (n > 0)
+		vm_out_len += n;
+	return n;
+}
+
+/*
+ * vm_syscall() - run syscall op on the n arguments pushed below a
+ */
+int vm_syscall(int op, int *a, int n) {
+	int *t;
+
+	switch (op) {
+	case OPEN: return open((char *) a[1], *a);
+	case READ:
+		vm_flush();
+		return read(a[2], (char *) a[1], *a);
+	case CLOS: return close(*a);
+	case PRTF:
+		t = a + n;
+		return vm_print(1, (char *) t[-1], t - 1);
+	case FPRT:
+		// fprintf(fd, fmt, ...) with fd 1 or 2
+		t = a + n;
+		return vm_print(t[-1], (char *) t[-2], t - 2);
+	case MALC: return (int) vm_malloc(*a);
+	case MSET: return (int) memset((char *) a[2], a[1], *a);
+	case MCMP: return memcmp((char *) a[2], (char *) a[1], *a);
+	}
+	return 0;
+}
+
+// main() returns into this in the register form
+int reg_halt[4] = {RHALT};
+
+// the words an ENT leaves free below its frame for what the body pushes
+enum {VM_HEADROOM = 1024};
+
+/*
+ * vm_overflow() - report a frame that doesn't fit on the VM stack
+ */
+int vm_overflow() {
+	vm_flush();
+	fprintf(stderr, "error - stack overflow\n");
+	return -1;
+}
+
+/*
+ * run_reg() - interpret the register form from the pc and stack run() set up
+ */
+int run_reg() {
+	int op, d, a, b;
+
+	while (1) {
+		op = *pc;
+		d = pc[1];
+		a = pc[2];
+		b = pc[3];
+		pc = pc + 4;
+		++cycle;
+		switch (op) {
+		case RLI:  bp[d] = a; break;
+		case RMOV: bp[d] = bp[a]; break;
+		case RLEA: bp[d] = (int) (bp + a); break;
+		case RLW:  bp[d] = *(int *) bp[a]; break;
+		case RLC:  bp[d] = *(char *) bp[a]; break;
+		case RSW:  *(int *) bp[d] = bp[a]; break;
+		case RSC:  bp[b] = *(char *) bp[d] = bp[a]; break;
+		case RJMP: pc = (int *) d; break;
+		case RBZ:  if (!bp[a]) pc = (int *) d; break;
+		case RBNZ: if (bp[a]) pc = (int *) d; break;
+		case RARG: *--sp = bp[a]; break;
+		case RCALL: *--sp = (int) pc; pc = (int *) d; break;
+		case RSYS:
+			if (a == EXIT) {
+				vm_flush();
+				return *sp;
+			}
+			bp[d] = vm_syscall(a, sp, b);
+			break;
+		case RADJ: sp = sp + d; break;
+		case RENT:
+			*--sp = (int) bp;
+			bp = sp;
+			if ((sp = sp - d) < stack + VM_HEADROOM)
+				return vm_overflow();
+			break;
+		case RRET: ax = bp[a];
+		case RLEV: sp = bp; bp = (int *) *sp++; pc = (int *) *sp++; break;
+		case RAX:  bp[d] = ax; break;
+		case RHALT:
+			vm_flush();
+			return ax;
+
+		case ROR:  bp[d] = bp[a] | bp[b]; break;
+		case RXOR: bp[d] = bp[a] ^ bp[b]; break;
+		case RAND: bp[d] = bp[a] & bp[b]; break;
+		case REQ:  bp[d] = bp[a] == bp[b]; break;
+		case RNEQ: bp[d] = bp[a] != bp[b]; break;
+		case RLT:  bp[d] = bp[a] < bp[b]; break;
+		case RGT:  bp[d] = bp[a] > bp[b]; break;
+		case RLE:  bp[d] = bp[a] <= bp[b]; break;
+		case RGE:  bp[d] = bp[a] >= bp[b]; break;
+		case RSHL: bp[d] = bp[a] << bp[b]; break;
+		case RSHR: bp[d] = bp[a] >> bp[b]; break;
+		case RADD: bp[d] = bp[a] + bp[b]; break;
+		case RSUB: bp[d] = bp[a] - bp[b]; break;
+		case RMUL: bp[d] = bp[a] * bp[b]; break;
+		case RDIV: bp[d] = bp[a] / bp[b]; break;
+		case RMOD: bp[d] = bp[a] % bp[b]; break;
+
+		case RORI:  bp[d] = bp[a] | b; break;
+		case RXORI: bp[d] = bp[a] ^ b; break;
+		case RANDI: bp[d] = bp[a] & b; break;
+		case REQI:  bp[d] = bp[a] == b; break;
+		case RNEQI: bp[d] = bp[a] != b; break;
+		case RLTI:  bp[d] = bp[a] < b; break;
+		case RGTI:  bp[d] = bp[a] > b; break;
+		case RLEI:  bp[d] = bp[a] <= b; break;
+		case RGEI:  bp[d] = bp[a] >= b; break;
+		case RSHLI: bp[d] = bp[a] << b; break;
+		case RSHRI: bp[d] = bp[a] >> b; break;
+		case RADDI: bp[d] = bp[a] + b; break;
+		case RSUBI: bp[d] = bp[a] - b; break;
+		case RMULI: bp[d] = bp[a] * b; break;
+		case RDIVI: bp[d] = bp[a] / b; break;
+		case RMODI: bp[d] = bp[a] % b; break;
+		default:
+			vm_flush();
+			fprintf(stderr, "error - unknown instruction %d\n", op);
+			return -1;
+		}
+	}
+}
+
+/*
+ * run() - execute main() of the compiled program on the virtual machine
+ *
+ * The registers are pc, bp, sp and the accumulator ax. Arguments are pushed
+ * left to right, so the last one is on top of the stack when a syscall or
+ * a function runs. cycle counts the executed instructions.
+ */
+int run(int argc, char **argv) {
+	int op, i, *t;
+
+	if (id_main->class != Func || !id_main->val)
+		err_exit("error - main() not defined\n");
+
+	// main() returns into a PUSH, EXIT stub at the top of the stack
+	bp = sp = (int *) ((int) stack + pool_size);
+	*--sp = EXIT;
+	*--sp = PUSH;
+	t = sp;
+	*--sp = argc;
+	*--sp = (int) argv;
+	*--sp = reg_vm ? (int) reg_halt : (int) t;
+	pc = (int *) id_main->val;
+	ax = 0;
+	cycle = 0;
+	vm_reset();
+	if (reg_vm)
+		return run_reg();
+	if (profile) {
+		profile_init();
+		profile_call(id_main->val);
+	}
+	if (pgo_gen) {
+		if (!pgo_exec && (!(pgo_exec = malloc(pool_size)) || !(pgo_taken = malloc(pool_size))))
+			err_exit("could not malloc for the pgo counters\n");
+		memset(pgo_exec, 0, pool_size);
+		memset(pgo_taken, 0, pool_size);
+	}
+
+	while (1) {
+		op = *pc++;
+		++cycle;
+		if (pgo_gen && (op == BZ || op == BNZ || op == CALL || op == TAIL)) {
+			pgo_exec[pc - 1 - text]++;
+			if (op == BZ ? !ax : op == BNZ && ax)
+				pgo_taken[pc - 1 - text]++;
+		}
+		if (profile) {
+			prof_ops[op]++;
+			prof_nodes[prof_cur].self++;
+			if (op == CALL)
+				profile_call(*pc);
+			else if (op == LEV || op == RET)
+				profile_return();
+			else if (op == TAIL) {
+				profile_return();
+				profile_call(pc[2]);
+			}
+		}
+		switch (op) {
+		case LEA:  ax = (int) (bp + *pc++); break;
+		case LEAS: ax = (int) (sp + *pc++); break;
+		case IMM:
+		case IMMD: ax = *pc++; break;
+		case JMP:  pc = (int *) *pc; break;
+		case CALL: *--sp = (int) (pc + 1); pc = (int *) *pc; break;
+		case BZ:   pc = ax ? pc + 1 : (int *) *pc; break;
+		case BNZ:  pc = ax ? (int *) *pc : pc + 1; break;
+		case ENT:
+			*--sp = (int) bp;
+			bp = sp;
+			if ((sp = sp - *pc++) < stack + VM_HEADROOM)
+				return vm_overflow();
+			break;
+		case TAIL:
+			// move the arguments pushed for the call over ours and drop
+			// the frame, the JMP after TAIL enters the callee
+			for (t = bp + 2, i = *pc++; i--; )
+				*t++ = *sp++;
+			sp = bp + 1;
+			bp = (int *) *bp;
+			break;
+		case VEC:  pc++; break;
+		case ADJ:  sp = sp + *pc++; break;
+		case LEV:  sp = bp; bp = (int *) *sp++; pc = (int *) *sp++; break;
+		case RET:  pc = (int *) *sp++; break;
+		case LW:   ax = *(int *) ax; break;
+		case LC:   ax = *(char *) ax; break;
+		case SW:   *(int *) *sp++ = ax; break;
+		case SC:   ax = *(char *) *sp++ = ax; break;
+		case PUSH: *--sp = ax; break;
+
+		case OR:   ax = *sp++ | ax; break;
+		case XOR:  ax = *sp++ ^ ax; break;
+		case AND:  ax = *sp++ & ax; break;
+		case EQ:   ax = *sp++ == ax; break;
+		case NEQ:  ax = *sp++ != ax; break;
+		case LT:   ax = *sp++ < ax; break;
+		case GT:   ax = *sp++ > ax; break;
+		case LE:   ax = *sp++ <= ax; break;
+		case GE:   ax = *sp++ >= ax; break;
+		case SHL:  ax = *sp++ << ax; break;
+		case SHR:  ax = *sp++ >> ax; break;
+		case ADD:  ax = *sp++ + ax; break;
+		case SUB:  ax = *sp++ - ax; break;
+		case MUL:  ax = *sp++ * ax; break;
+		case DIV:  ax = *sp++ / ax; break;
+		case MOD:  ax = *sp++ % ax; break;
+
+		// the ADJ after a syscall says how many arguments it has
+		case OPEN:
+		case READ:
+		case CLOS:
+		case PRTF:
+		case FPRT:
+		case MALC:
+		case MSET:
+		case MCMP:
+			ax = vm_syscall(op, sp, pc[1]);
+			break;
+		case EXIT:
+			vm_flush();
+			return *sp;
+		default:
+			vm_flush();
+			fprintf(stderr, "error - unknown instruction %d\n", op);
+			return -1;
+		}
+	}
+}
+
+/*
+ * init_compiler() - allocate the pools and seed the symbol table
+ *
+ * This only has to run once per process. Keywords and syscalls stay at the
+ * front of sym and everything behind sym_user belongs to a translation unit.
+ */
+void init_compiler() {
+	int i;
+
+	pool_size = 256 * 1024;
+	ir_out = stdout;
+	if (!(src = malloc(pool_size))) {
+		err_exit("error - couldn't malloc for source code text.\n");
+	}
+	
+	if (!(sym = malloc(pool_size))) {
+		err_exit("error - couldn't malloc for symbol table.\n");
+	}
+
+	if (!(stack = stack_p = malloc(pool_size))) {
+		err_exit("error - couldn't malloc for stack segment.\n");
+	}
+
+	if (!(rodata = rodata_p = malloc(pool_size))) {
+		err_exit("error - couldn't malloc for rodata section.\n");
+	}
+
+	// .bss is zero from the start, its pages are only touched when used
+	if (!(bss = bss_p = calloc(pool_size, 1))) {
+		err_exit("error - couldn't malloc for bss section.\n");
+	}
+
+	if (!(text = text_p = malloc(pool_size))) {
+		err_exit("error - couldn't malloc for text segment.\n");
+	}
+
+	if (!(type_size = malloc(PTR * sizeof(int)))) {
+		err_exit("error - couldn't malloc for type size table\n");
+	}
+
+	if (!(type_align = malloc(PTR * sizeof(int)))) {
+		err_exit("error - couldn't malloc for type alignment table\n");
+	}
+
+	if (!(layouts = malloc(PTR * sizeof(struct struct_layout)))) {
+		err_exit("error - couldn't malloc for struct layout table\n");
+	}
+
+	if (!(ast = malloc(pool_size))) {
+		err_exit("error - couldn;t malloc for abstract syntax tree\n");
+	}
+
+	if (!(funcs = malloc(pool_size))) {
+		err_exit("error - couldn't malloc for function table\n");
+	}
+
+	if (!(tu_jumps = malloc(5 * pool_size))) {
+		err_exit("error - couldn't malloc for jump tables\n");
+	}
+
+	memset(src, 0, pool_size);
+	memset(sym, 0, pool_size);
+	memset(stack, 0, pool_size);
+	memset(rodata, 0, pool_size);
+	memset(text, 0, pool_size);
+	memset(type_size, 0, PTR * sizeof(int));
+	memset(type_align, 0, PTR * sizeof(int));
+	memset(layouts, 0, PTR * sizeof(struct struct_layout));
+	memset(ast, 0, pool_size);
+
+	ast_ptr = ast_top = (int *)((int)ast + pool_size);
+
+	// seed sym with the names and hashes of the generated keyword table
+	for (i = 0; i < KW_COUNT; i++) {
+		sym[i].token = Id;
+		sym[i].name = kw_name[i];
+		sym[i].hash = kw_hash[i];
+	}
+
+	// C Keywords
+	for (i = Break; i <= Goto; i++) {
+		id = sym + i - Break;
+		id->token = i;
+		id->class = Keyword;
+	}
+
+	// void
+	sym[KW_VOID].token = Char;
+
+	// main
+	id_main = sym + KW_MAIN;
+
+	// Syscalls / C std funcs
+	for (i = OPEN; i <= EXIT; i++) {
+		id = sym + KW_SYSCALL + i - OPEN;
+		id->type = INT;
+		id->class = Syscall;
+		id->val = i;
+	}
+	sym_user = sym + KW_COUNT;
+
+	type_align[type_new] = sizeof(char);
+	type_size[type_new++] = sizeof(char);
+	type_align[type_new] = sizeof(int);
+	type_size[type_new++] = sizeof(int);
+	type_builtin = type_new;
+}
+
+/*
+ * reset_tu() - forget everything the previous translation unit left behind
+ *
+ * Only the parts of the pools that were actually used get cleared, so the
+ * cost is proportional to the size of the previous file, not the pool size.
+ */
+void reset_tu() {
+	for (id = sym_user; id->token; id++)
+		;
+	memset(sym_user, 0, (char *) id - (char *) sym_user);
+	// main() is seeded with the keywords but belongs to the unit
+	id_main->class = id_main->type = id_main->val = 0;
+	id_main->fixup = id_main->inline_tree = id_main->pure = 0;
+	id_main->ir = 0;
+	id_main->live = id_main->used = id_main->seq = 0;
+	lazy_pass = decl_seq = 0;
+	func_cnt = tu_index = vec_cnt = 0;
+
+	memset(rodata, 0, rodata_p - rodata);
+	memset(bss, 0, bss_p - bss);
+	if (text_end)
+		memset(text, 0, (text_end - text + 1) * sizeof(int));
+	rodata_p = rodata;
+	bss_p = bss;
+	bss_align = 1;
+	text_p = text;
+	text_limit = text + pool_size / sizeof(int) - 64;
+	stack_p = stack;
+	ast_ptr = ast_top = (int *)((int)ast + pool_size);
+	expr_depth = 0;
+	// compiles are serialized, so the thread doing this one takes the tables
+	case_addr = tu_jumps;
+	case_val = case_addr + pool_size / sizeof(int);
+	case_node = case_val + pool_size / sizeof(int);
+	break_addr = case_node + pool_size / sizeof(int);
+	continue_addr = break_addr + pool_size / sizeof(int);
+	default_addr = 0;
+	switch_cnt = break_cnt = continue_cnt = cold_cnt = 0;
+	elide = 0;
+	loop_depth = switch_depth = 0;
+	mod_bss_end = bss;
+
+	while (type_new > type_builtin) {
+		--type_new;
+		free(layouts[type_new].member);
+		free(layouts[type_new].index);
+		memset(&layouts[type_new], 0, sizeof(struct struct_layout));
+		type_size[type_new] = 0;
+		type_align[type_new] = 0;
+	}
+}
+
+/*
+ * parse_src() - parse the len bytes of source text at the start of src
+ */
+void parse_src(int len) {
+	src[len] = 0;
+	last_p = p = src;
+	line = 1;
+
+	// with --jobs the file is lexed ahead on as many threads
+	tok_free();
+	if (gen_jobs > 1)
+		tokenize(len, gen_jobs);
+	program();
+	tok_free();
+}
+
+void mod_link();
+
+/*
+ * compile_src() - compile the len bytes of source text at the start of src
+ */
+void compile_src(int len) {
+	reset_tu();
+	mod_link();
+	parse_src(len);
+	text_end = text_p;
+}
+
+/*
+ * compile_buffer() - compile source text from memory
+ */
+void compile_buffer(char *buf, int len) {
+	if (len > pool_size - 1)
+		err_exit("error - source text too large\n");
+	memcpy(src, buf, len);
+	compile_src(len);
+}
+
+/*
+ * Overlapped I/O. When there are several sources, a reader thread reads
+ * them in order while the compiler works, at most IO_AHEAD files ahead of
+ * it, so the next file is in memory by the time the current one has been
+ * compiled. The assembly the targets produce goes to a writer thread,
+ * which writes it out while the next file compiles.
+ */
+enum {IO_AHEAD = 2, IO_TID = 1000};
+struct io_file {
+	char *path;
+	char *buf;
+	int len;
+	struct io_file *next;
+};
+pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t io_cond = PTHREAD_COND_INITIALIZER;
+pthread_t io_reader_thread, io_writer_thread;
+// the sources the reader goes through, how many it has read and how many were taken
+char **io_paths;
+struct io_file *io_in;
+int io_n, io_read, io_taken, io_stop;
+// the outputs waiting for the writer, and the first that couldn't be written
+struct io_file *io_out, *io_out_last;
+int io_writing, io_closing;
+char *io_werr;
+
+/*
+ * io_reader() - read the sources into io_in
+ */
+void *io_reader(void *arg) {
+	char *buf;
+	int i, fd, len, n, ev;
+
+	trace_tid = IO_TID;
+	for (i = 0; i < io_n; i++) {
+		pthread_mutex_lock(&io_lock);
+		while (i - io_taken >= IO_AHEAD && !io_stop)
+			pthread_cond_wait(&io_cond, &io_lock);
+		pthread_mutex_unlock(&io_lock);
+		if (io_stop)
+			break;
+
+		ev = trace_begin("read source", io_paths[i], -1);
+		buf = 0;
+		len = -1;
+		if ((fd = open(io_paths[i], 0)) >= 0) {
+			if ((buf = malloc(pool_size)))
+				for (len = 0; len < pool_size && (n = read(fd, buf + len, pool_size - len)) > 0; )
+					len += n;
+			close(fd);
+		}
+		trace_end(ev);
+
+		pthread_mutex_lock(&io_lock);
+		io_in[i].buf = buf;
+		io_in[i].len = len;
+		io_read = i + 1;
+		pthread_cond_broadcast(&io_cond);
+		pthread_mutex_unlock(&io_lock);
+	}
+	return 0;
+}
+
+/*
+ * io_prefetch() - start reading the n sources at paths ahead
+ */
+void io_prefetch(int n, char **paths) {
+	if (n < 2 || !(io_in = calloc(n, sizeof(struct io_file))))
+		return;
+	io_paths = paths;
+	io_n = n;
+	io_read = io_taken = io_stop = 0;
+	if (pthread_create(&io_reader_thread, 0, io_reader, 0)) {
+		free(io_in);
+		io_n = 0;
+	}
+}
+
+/*
+ * io_take() - move the next prefetched source into src and return its
+ * length, or -1 when path isn't the next one
+ */
+int io_take(char *path) {
+	struct io_file *in;
+	int i;
+
+	if (io_taken == io_n || io_paths[io_taken] != path)
+		return -1;
+	pthread_mutex_lock(&io_lock);
+	while (io_read <= io_taken)
+		pthread_cond_wait(&io_cond, &io_lock);
+	in = &io_in[io_taken++];
+	pthread_cond_broadcast(&io_cond);
+	pthread_mutex_unlock(&io_lock);
+
+	if (!in->buf) {
+		fprintf(stderr, "error - for source file %s\n", path);
+		err_exit("couldn't open the source file.\n");
+	}
+	if ((i = in->len) <= 0 || i > pool_size - 1) {
+		free(in->buf);
+		in->buf = 0;
+		fprintf(stderr, "error - for source file %s\n", path);
+		err_exit(i > 0 ? "source file too large\n" : "unable to read the source file\n");
+	}
+	memcpy(src, in->buf, i);
+	free(in->buf);
+	in->buf = 0;
+	return i;
+}
+
+/*
+ * io_writer() - write the queued outputs
+ */
+void *io_writer(void *arg) {
+	struct io_file *w;
+	int fd, i, n;
+
+	trace_tid = IO_TID + 1;
+	pthread_mutex_lock(&io_lock);
+	while (1) {
+		while (!io_out && !io_closing)
+			pthread_cond_wait(&io_cond, &io_lock);
+		if (!(w = io_out))
+			break;
+		if (!(io_out = w->next))
+			io_out_last = 0;
+		pthread_mutex_unlock(&io_lock);
+
+		i = 0;
+		if ((fd = open(w->path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0) {
+			for (; i < w->len && (n = write(fd, w->buf + i, w->len - i)) > 0; i += n)
+				;
+			close(fd);
+		}
+		pthread_mutex_lock(&io_lock);
+		if ((fd < 0 || i < w->len) && !io_werr)
+			io_werr = w->path;
+		else
+			free(w->path);
+		free(w->buf);
+		free(w);
+	}
+	pthread_mutex_unlock(&io_lock);
+	return 0;
+}
+
+/*
+ * io_write() - queue len bytes at buf, which the writer frees, to be
+ * written to path
+ */
+void io_write(char *path, char *buf, int len) {
+	struct io_file *w;
+
+	if (!(w = malloc(sizeof(struct io_file))) || !(w->path = strdup(path)))
+		err_exit("error - couldn't malloc for an output\n");
+	w->buf = buf;
+	w->len = len;
+	w->next = 0;
+	pthread_mutex_lock(&io_lock);
+	if (!io_writing && !pthread_create(&io_writer_thread, 0, io_writer, 0))
+		io_writing = 1;
+	if (io_out_last)
+		io_out_last->next = w;
+	else
+		io_out = w;
+	io_out_last = w;
+	pthread_cond_broadcast(&io_cond);
+	pthread_mutex_unlock(&io_lock);
+}
+
+/*
+ * io_finish() - stop the reader and wait until the outputs are written
+ *
+ * Only the end of compile_args() calls it. An error ends the process
+ * before, so the reader and the writer go with it.
+ */
+void io_finish() {
+	struct io_file *w;
+	int i;
+
+	if (io_n) {
+		pthread_mutex_lock(&io_lock);
+		io_stop = 1;
+		pthread_cond_broadcast(&io_cond);
+		pthread_mutex_unlock(&io_lock);
+		pthread_join(io_reader_thread, 0);
+		for (i = 0; i < io_read; i++)
+			free(io_in[i].buf);
+		free(io_in);
+		io_n = 0;
+	}
+	if (io_writing) {
+		pthread_mutex_lock(&io_lock);
+		io_closing = 1;
+		pthread_cond_broadcast(&io_cond);
+		pthread_mutex_unlock(&io_lock);
+		pthread_join(io_writer_thread, 0);
+		io_writing = io_closing = 0;
+	}
+	// what was queued when the writer couldn't start
+	while ((w = io_out)) {
+		io_out = w->next;
+		if (!io_werr)
+			io_werr = w->path;
+		else
+			free(w->path);
+		free(w->buf);
+		free(w);
+	}
+	io_out_last = 0;
+	if (io_werr) {
+		fprintf(stderr, "error - couldn't write %s\n", io_werr);
+		free(io_werr);
+		io_werr = 0;
+		err_exit("error - the outputs weren't all written\n");
+	}
+}
+
+/*
+ * read_source() - read a source file into src and return its length
+ */
+int read_source(char *path) {
+	int fd, i, n, ev;
+
+	if ((i = io_take(path)) >= 0)
+		return i;
+	if ((fd = open(path, 0)) < 0) {
+		fprintf(stderr, "error - for source file %s\n", path);
+		err_exit("couldn't open the source file.\n");
+	}
+
+	ev = trace_begin("read source", path, -1);
+	// a byte more than fits tells a file that is too large
+	for (i = 0; i < pool_size && (n = read(fd, src + i, pool_size - i)) > 0; )
+		i += n;
+	if (i <= 0 || i > pool_size - 1) {
+		fprintf(stderr, "error - for source file %s\n", path);
+		err_exit(i > 0 ? "source file too large\n" : "unable to read the source file\n");
+	}
+	close(fd);
+	trace_end(ev);
+	return i;
+}
+
+/*
+ * compile_file() - read a source file into src and compile it
+ */
+void compile_file(char *path) {
+	int i, ev;
+
+	i = read_source(path);
+	ev = trace_begin("program", path, -1);
+	compile_src(i);
+	trace_end(ev);
+}
+
+/*
+ * compile_program() - compile n source files as one program
+ *
+ * The files share one symbol table, so each keeps its own source text for
+ * the names that point into it.
+ */
+void compile_program(int n, char **paths) {
+	char *first, **texts;
+	int i, len, ev;
+
+	reset_tu();
+	first = src;
+	if (!(texts = malloc(n * sizeof(char *))))
+		err_exit("error - couldn't malloc for source texts\n");
+	for (i = 0; i < n; i++) {
+		if (i && !(src = malloc(pool_size)))
+			err_exit("error - couldn't malloc for source code text.\n");
+		texts[i] = src;
+		len = read_source(paths[i]);
+		++tu_index;
+		ev = trace_begin("program", paths[i], -1);
+		parse_src(len);
+		trace_end(ev);
+	}
+	if (lazy_bodies)
+		parse_lazy();
+	wp_emit();
+	text_end = text_p;
+
+	for (i = 1; i < n; i++)
+		free(texts[i]);
+	free(texts);
+	src = first;
+}
+
+/*
+ * Precompiled modules. --emit-module writes the code of a unit together
+ * with its symbols, struct layouts and names to a file that --module maps
+ * before another unit is parsed, so a library is compiled once and linked
+ * into every program that uses it. Everything in the file is addressed by
+ * offset and nothing is deserialized: the symbols and the struct members
+ * are read from the mapping and their names stay in its string pool. Only
+ * the code and .rodata are copied, as the VM addresses them absolutely,
+ * and .bss has just a size. The jumps and calls of the text hold word
+ * offsets into it, IMMD operands and globals offsets into .rodata followed
+ * by .bss, and the struct types are numbered from type_builtin, all three
+ * are relocated when the module is linked. MOD_VERSION changes with the
+ * opcodes and with the layout of the file.
+ */
+enum {MOD_MAGIC = 0x646f6d78, MOD_VERSION = 2};
+enum {MOD_TEXT, MOD_RODATA, MOD_BSS, MOD_SYMS, MOD_TYPES, MOD_MEMBERS, MOD_STRS, MOD_SECTS};
+struct mod_header {
+	int magic;
+	int version;
+	// the struct types, which follow the builtin ones
+	int types;
+	// [offset][size][alignment] of every section in bytes, .bss has no
+	// bytes in the file and offset 0
+	int sect[MOD_SECTS][3];
+};
+struct mod_sym {
+	int name;
+	int hash;
+	int class;
+	int type;
+	int val;
+	int struct_type;
+};
+struct mod_type {
+	int size;
+	int align;
+	// the first of its members, count is -1 for an incomplete type
+	int member;
+	int count;
+};
+struct mod_member {
+	int name;
+	int hash;
+	int type;
+	int offset;
+};
+// the modules of --module in the order they are linked
+struct module {
+	char *path;
+	struct mod_header *h;
+	int size;
+	struct module *next;
+} *modules, *modules_last;
+
+/*
+ * mod_open() - map the module at path for the units compiled after it
+ */
+void mod_open(char *path) {
+	struct module *m;
+	struct mod_header *h;
+	struct stat st;
+	void *map;
+	int fd, i, bad;
+
+	if ((fd = open(path, 0)) < 0) {
+		fprintf(stderr, "error - for module %s\n", path);
+		err_exit("couldn't open the module.\n");
+	}
+	map = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= sizeof(struct mod_header))
+		map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "error - for module %s\n", path);
+		err_exit("couldn't map the module.\n");
+	}
+
+	h = map;
+	bad = h->magic != MOD_MAGIC || h->version != MOD_VERSION || h->types < 0 || h->types >= PTR;
+	for (i = 0; i < MOD_SECTS && !bad; i++)
+		bad = h->sect[i][1] < 0 || h->sect[i][2] <= 0 || h->sect[i][2] & (h->sect[i][2] - 1) || h->sect[i][2] > 4096 ||
+		      (i != MOD_BSS && (h->sect[i][0] < sizeof(struct mod_header) || h->sect[i][0] & 3 ||
+					h->sect[i][1] > st.st_size - h->sect[i][0]));
+	if (!bad)
+		bad = h->sect[MOD_TEXT][1] & 3 || h->sect[MOD_TYPES][1] != h->types * sizeof(struct mod_type);
+	if (bad) {
+		munmap(map, st.st_size);
+		fprintf(stderr, "error - for module %s\n", path);
+		err_exit("not a module of this version of maxcc\n");
+	}
+
+	if (!(m = malloc(sizeof(struct module))))
+		err_exit("error - couldn't malloc for a module\n");
+	m->path = path;
+	m->h = h;
+	m->size = st.st_size;
+	m->next = 0;
+	if (modules_last)
+		modules_last->next = m;
+	else
+		modules = m;
+	modules_last = m;
+}
+
+/*
+ * mod_close() - unmap every module
+ */
+void mod_close() {
+	struct module *m;
+
+	while ((m = modules)) {
+		modules = m->next;
+		munmap(m->h, m->size);
+		free(m);
+	}
+	modules_last = 0;
+}
+
+/*
+ * mod_bad() - report a module whose contents don't add up
+ */
+void mod_bad(struct module *m) {
+	fprintf(stderr, "error - for module %s\n", m->path);
+	err_exit("the module is corrupt\n");
+}
+
+/*
+ * mod_ident() - enter the name at offset name of the string pool of m,
+ * as lookup_ident() does
+ */
+void mod_ident(struct module *m, int name, int hash) {
+	if (name < 0 || name > m->h->sect[MOD_STRS][1] - (hash & 0x3f))
+		mod_bad(m);
+	lookup_ident((char *) m->h + m->h->sect[MOD_STRS][0] + name, hash & 0x3f, hash);
+}
+
+/*
+ * mod_type() - a type of a module as a type of the unit, whose struct
+ * types start shift after the builtin ones
+ */
+int mod_type(int type, int shift) {
+	return (type & (PTR - 1)) >= type_builtin ? type + shift : type;
+}
+
+/*
+ * mod_link() - enter the code, the data, the struct types and the symbols
+ * of every module into the unit about to be parsed
+ */
+void mod_link() {
+	struct module *m;
+	struct mod_header *h;
+	struct mod_sym *s;
+	struct mod_type *t;
+	struct mod_member *mm;
+	struct struct_layout *l;
+	char *base, *rbase, *bbase, errstr[128];
+	int *tbase, *pc, i, j, n, rsize, nmembers, shift;
+
+	for (m = modules; m; m = m->next) {
+		h = m->h;
+		base = (char *) h;
+		n = h->sect[MOD_TEXT][1] / sizeof(int);
+		rsize = h->sect[MOD_RODATA][1];
+		if (text_p + n > text_limit)
+			err_exit("error - text segment overflow\n");
+		rodata_p = (char *) (((int) rodata_p + h->sect[MOD_RODATA][2] - 1) & -h->sect[MOD_RODATA][2]);
+		if (rsize > rodata + pool_size - sizeof(int) - rodata_p)
+			err_exit("error - rodata section overflow\n");
+		bss_p = (char *) (((int) bss_p + h->sect[MOD_BSS][2] - 1) & -h->sect[MOD_BSS][2]);
+		if (h->sect[MOD_BSS][1] > bss + pool_size - bss_p)
+			err_exit("error - bss section overflow\n");
+		if (h->sect[MOD_BSS][2] > bss_align)
+			bss_align = h->sect[MOD_BSS][2];
+		if (type_new + h->types > PTR)
+			err_exit("error - too many struct/union types\n");
+
+		// the code and .rodata, relocated to where they land, and .bss
+		tbase = text_p;
+		rbase = rodata_p;
+		bbase = bss_p;
+		memcpy(tbase + 1, base + h->sect[MOD_TEXT][0], n * sizeof(int));
+		memcpy(rbase, base + h->sect[MOD_RODATA][0], rsize);
+		text_p += n;
+		rodata_p += rsize;
+		bss_p += h->sect[MOD_BSS][1];
+		for (pc = tbase + 1; pc <= text_p; pc += *pc <= ADJ ? 2 : 1) {
+			// every word is an instruction, one with an operand has it
+			if (*pc < LEA || *pc > EXIT || (*pc <= ADJ && pc == text_p) || (*pc == VEC && pc[1]))
+				mod_bad(m);
+			if (*pc == JMP || *pc == BZ || *pc == BNZ || *pc == CALL) {
+				if (pc[1] <= 0 || pc[1] > n)
+					mod_bad(m);
+				pc[1] = (int) (tbase + pc[1]);
+			}
+			else if (*pc == IMMD) {
+				if (pc[1] < 0 || pc[1] > rsize + h->sect[MOD_BSS][1])
+					mod_bad(m);
+				pc[1] = pc[1] < rsize ? (int) rbase + pc[1] : (int) bbase + pc[1] - rsize;
+			}
+		}
+
+		// the struct types, whose members are named by the unit's idents
+		shift = type_new - type_builtin;
+		t = (struct mod_type *) (base + h->sect[MOD_TYPES][0]);
+		mm = (struct mod_member *) (base + h->sect[MOD_MEMBERS][0]);
+		nmembers = h->sect[MOD_MEMBERS][1] / sizeof(struct mod_member);
+		for (i = 0; i < h->types; i++, t++) {
+			type_size[type_new] = t->size;
+			type_align[type_new] = t->align;
+			l = &layouts[type_new++];
+			l->tu = -1;
+			if (t->count < 0)
+				continue;
+			if (t->member < 0 || t->count > nmembers - t->member)
+				mod_bad(m);
+			if (!(l->member = malloc((t->count + 1) * sizeof(struct struct_member))))
+				err_exit("error - couldn't malloc for a struct layout\n");
+			l->count = t->count;
+			for (j = 0; j < t->count; j++) {
+				mod_ident(m, mm[t->member + j].name, mm[t->member + j].hash);
+				l->member[j].id = id;
+				l->member[j].type = mod_type(mm[t->member + j].type, shift);
+				l->member[j].offset = mm[t->member + j].offset;
+			}
+			struct_index(l);
+		}
+
+		// the symbols, a name two modules define is an error
+		s = (struct mod_sym *) (base + h->sect[MOD_SYMS][0]);
+		for (i = h->sect[MOD_SYMS][1] / sizeof(struct mod_sym); i--; s++) {
+			mod_ident(m, s->name, s->hash);
+			if (id->token != Id || id->class || id->struct_type) {
+				sprintf(errstr, "error - %.*s is defined by more than one module\n", s->hash & 0x3f, id->name);
+				err_exit(errstr);
+			}
+			id->class = s->class;
+			id->type = mod_type(s->type, shift);
+			if (s->class == Func)
+				id->val = (int) (tbase + s->val);
+			else if (s->class == Global)
+				id->val = (int) bbase + s->val - rsize;
+			else
+				id->val = s->val;
+			if (s->struct_type)
+				id->struct_type = mod_type(s->struct_type, shift);
+		}
+	}
+	mod_bss_end = bss_p;
+}
+
+/*
+ * mod_export() - whether the symbol table of a module has d
+ */
+int mod_export(struct ident *d) {
+	return d->class == Func ? d->val != 0 : d->class == Global || d->class == Num || d->struct_type;
+}
+
+/*
+ * mod_addr() - the offset a module gives the address a in .rodata or .bss
+ */
+int mod_addr(int a) {
+	if (a >= (int) bss && a <= (int) bss + pool_size)
+		return a - (int) bss + (rodata_p - rodata);
+	return a - (int) rodata;
+}
+
+/*
+ * mod_pad() - end the word aligned section that started at sect of the
+ * module being written in f, and pad it to a word
+ */
+void mod_pad(FILE *f, int *sect) {
+	sect[1] = ftell(f) - sect[0];
+	sect[2] = sizeof(int);
+	while (ftell(f) & 3)
+		fputc(0, f);
+}
+
+/*
+ * mod_emit() - write the unit that was just compiled as a module to path
+ */
+void mod_emit(char *path) {
+	struct mod_header h;
+	struct mod_sym s;
+	struct mod_type t;
+	struct mod_member mm;
+	struct struct_layout *l;
+	struct ident *d;
+	char *buf;
+	size_t len;
+	FILE *f;
+	int *pc, i, j, w, name, member;
+
+	if (!(f = open_memstream(&buf, &len)))
+		err_exit("error - couldn't malloc for the module\n");
+	memset(&h, 0, sizeof(h));
+	h.magic = MOD_MAGIC;
+	h.version = MOD_VERSION;
+	h.types = type_new - type_builtin;
+	fwrite(&h, sizeof(h), 1, f);
+
+	// the text, with the addresses it holds made offsets
+	h.sect[MOD_TEXT][0] = ftell(f);
+	for (pc = text + 1; pc <= text_p; pc++) {
+		fwrite(pc, sizeof(int), 1, f);
+		if (*pc > ADJ)
+			continue;
+		w = pc[1];
+		if (*pc == JMP || *pc == BZ || *pc == BNZ || *pc == CALL)
+			w = (int *) w - text;
+		else if (*pc == IMMD)
+			w = mod_addr(w);
+		// the loop descriptors stay behind, the loops are left scalar
+		else if (*pc == VEC)
+			w = 0;
+		fwrite(&w, sizeof(int), 1, f);
+		pc++;
+	}
+	mod_pad(f, h.sect[MOD_TEXT]);
+
+	h.sect[MOD_RODATA][0] = ftell(f);
+	fwrite(rodata, 1, rodata_p - rodata, f);
+	mod_pad(f, h.sect[MOD_RODATA]);
+	// the literals are bytes
+	h.sect[MOD_RODATA][2] = 1;
+	h.sect[MOD_BSS][1] = bss_p - bss;
+	h.sect[MOD_BSS][2] = bss_align;
+
+	// the names are pooled in the order the symbols and members come in
+	name = 0;
+	h.sect[MOD_SYMS][0] = ftell(f);
+	for (d = sym_user; d->token; d++) {
+		if (!mod_export(d))
+			continue;
+		s.name = name;
+		s.hash = d->hash;
+		s.class = d->class == Func || d->class == Global || d->class == Num ? d->class : 0;
+		s.type = s.class ? d->type : 0;
+		s.val = d->class == Func ? (int *) d->val - text : d->class == Global ? mod_addr(d->val) : s.class ? d->val : 0;
+		s.struct_type = d->struct_type;
+		fwrite(&s, sizeof(s), 1, f);
+		name += (d->hash & 0x3f) + 1;
+	}
+	mod_pad(f, h.sect[MOD_SYMS]);
+
+	member = 0;
+	h.sect[MOD_TYPES][0] = ftell(f);
+	for (i = type_builtin; i < type_new; i++) {
+		l = &layouts[i];
+		t.size = type_size[i];
+		t.align = type_align[i];
+		t.member = member;
+		t.count = l->member ? l->count : -1;
+		fwrite(&t, sizeof(t), 1, f);
+		if (l->member)
+			member += l->count;
+	}
+	mod_pad(f, h.sect[MOD_TYPES]);
+
+	h.sect[MOD_MEMBERS][0] = ftell(f);
+	for (i = type_builtin; i < type_new; i++) {
+		l = &layouts[i];
+		for (j = 0; l->member && j < l->count; j++) {
+			mm.name = name;
+			mm.hash = l->member[j].id->hash;
+			mm.type = l->member[j].type;
+			mm.offset = l->member[j].offset;
+			fwrite(&mm, sizeof(mm), 1, f);
+			name += (mm.hash & 0x3f) + 1;
+		}
+	}
+	mod_pad(f, h.sect[MOD_MEMBERS]);
+
+	h.sect[MOD_STRS][0] = ftell(f);
+	for (d = sym_user; d->token; d++) {
+		if (mod_export(d)) {
+			fwrite(d->name, 1, d->hash & 0x3f, f);
+			fputc(0, f);
+		}
+	}
+	for (i = type_builtin; i < type_new; i++) {
+		l = &layouts[i];
+		for (j = 0; l->member && j < l->count; j++) {
+			fwrite(l->member[j].id->name, 1, l->member[j].id->hash & 0x3f, f);
+			fputc(0, f);
+		}
+	}
+	mod_pad(f, h.sect[MOD_STRS]);
+
+	if (fclose(f))
+		err_exit("error - couldn't write the module\n");
+	// the header, now that the sections are known
+	memcpy(buf, &h, sizeof(h));
+	io_write(path, buf, len);
+}
+
+/*
+ * Target backends. The stack code of a translation unit is the IR every
+ * target shares: --targets lowers it once per target, each on a thread of
+ * its own, to assembly in <src>.<target>.s. ax lives in a register, the VM
+ * stack is the machine stack and bp the frame pointer, so frames and calls
+ * keep the layout the VM gives them. Functions are named mx_<name> so they
+ * can't clash with the C library the syscalls go to, and main() enters
+ * through a stub that calls mx_main.
+ */
+struct target {
+	char *name;
+	// the main() stub and the start of the text
+	void (*begin)(FILE *f);
+	// the entry of a function, which keeps its return address on the stack
+	void (*entry)(FILE *f);
+	// one instruction, TAIL lowers together with the JMP after it
+	void (*op)(FILE *f, int *pc);
+	// a call, or the jump of a tail call
+	void (*call)(FILE *f, struct ident *d, int tail);
+	// the vector code of a VEC, or 0 to leave the loops scalar
+	void (*vec)(FILE *f, int *pc);
+	// a pass over the finished assembly, or 0
+	int (*post)(char **buf, size_t *len);
+};
+
+// jump targets and the function starting at each word of text
+char *tgt_label;
+struct ident **tgt_func;
+
+/*
+ * tgt_name() - print the symbol of the function at text address a
+ */
+void tgt_name(FILE *f, int a) {
+	struct ident *d;
+
+	d = tgt_func[(int *) a - text];
+	fprintf(f, "mx_%.*s", d->hash & 0x3f, d->name);
+}
+
+/*
+ * tgt_addr() - print the address a in .rodata or .bss as an offset from
+ * the symbol of its section
+ */
+void tgt_addr(FILE *f, int a) {
+	if (a >= (int) bss && a <= (int) bss + pool_size)
+		fprintf(f, "mx_bss+%d", a - (int) bss);
+	else
+		fprintf(f, "mx_rodata+%d", a - (int) rodata);
+}
+
+/*
+ * tgt_data() - print .rodata as the bytes of mx_rodata, and .bss as the
+ * size of mx_bss, which takes no room in the object
+ */
+void tgt_data(FILE *f) {
+	char *s;
+	int i;
+
+	fprintf(f, "\t.section .note.GNU-stack,\"\",%%progbits\n\t.section .rodata\nmx_rodata:\n");
+	for (s = rodata; s < rodata_p; s += 16) {
+		fprintf(f, "\t.byte %d", (unsigned char) *s);
+		for (i = 1; i < 16 && s + i < rodata_p; i++)
+			fprintf(f, ",%d", (unsigned char) s[i]);
+		fprintf(f, "\n");
+	}
+	fprintf(f, "\t.bss\n\t.balign %d\nmx_bss:\n", bss_align);
+	if (bss_p > bss)
+		fprintf(f, "\t.zero %d\n", bss_p - bss);
+}
+
+/*
+ * rv_addi() - rd = rs + v on RV32, which takes 12 bit immediates
+ */
+void rv_addi(FILE *f, char *rd, char *rs, int v) {
+	if (v >= -2048 && v < 2048)
+		fprintf(f, "\taddi %s, %s, %d\n", rd, rs, v);
+	else
+		fprintf(f, "\tli t0, %d\n\tadd %s, %s, t0\n", v, rd, rs);
+}
+
+void rv_begin(FILE *f) {
+	// s1 keeps sp while the stack is aligned for a call into libc
+	fprintf(f, "\t.option norvc\n\t.text\n\t.globl main\nmain:\n"
+		"\taddi sp, sp, -16\n\tsw ra, 12(sp)\n\tsw s0, 8(sp)\n\tsw s1, 4(sp)\n"
+		"\taddi sp, sp, -8\n\tsw a0, 4(sp)\n\tsw a1, 0(sp)\n"
+		"\tcall mx_main\n"
+		"\taddi sp, sp, 8\n\tlw s1, 4(sp)\n\tlw s0, 8(sp)\n\tlw ra, 12(sp)\n\taddi sp, sp, 16\n\tret\n");
+}
+
+void rv_entry(FILE *f) {
+	fprintf(f, "\taddi sp, sp, -4\n\tsw ra, 0(sp)\n");
+}
+
+/*
+ * rv_libc() - call fn with the syscall arguments at (n - 1 - i) words
+ * above sp in a<i + first>
+ */
+void rv_libc(FILE *f, char *fn, int first, int n, int cnt) {
+	int i;
+
+	for (i = 0; i < cnt; i++)
+		fprintf(f, "\tlw a%d, %d(sp)\n", i + first, (n - 1 - i) * 4);
+	fprintf(f, "\tmv s1, sp\n\tandi sp, sp, -16\n\tcall %s\n\tmv sp, s1\n", fn);
+}
+
+void rv_op(FILE *f, int *pc) {
+	int i, n;
+
+	switch (*pc) {
+	case LEA:  rv_addi(f, "a0", "s0", pc[1] * 4); break;
+	case LEAS: rv_addi(f, "a0", "sp", pc[1] * 4); break;
+	case IMM:  fprintf(f, "\tli a0, %d\n", pc[1]); break;
+	case IMMD:
+		fprintf(f, "\tla a0, ");
+		tgt_addr(f, pc[1]);
+		fprintf(f, "\n");
+		break;
+	case JMP:  fprintf(f, "\tj .L%d\n", (int *) pc[1] - text); break;
+	case BZ:   fprintf(f, "\tbeqz a0, .L%d\n", (int *) pc[1] - text); break;
+	case BNZ:  fprintf(f, "\tbnez a0, .L%d\n", (int *) pc[1] - text); break;
+	case ENT:
+		fprintf(f, "\taddi sp, sp, -4\n\tsw s0, 0(sp)\n\tmv s0, sp\n");
+		rv_addi(f, "sp", "sp", -pc[1] * 4);
+		break;
+	case TAIL:
+		// the arguments replace those of the caller, its frame goes
+		for (i = 0; i < pc[1]; i++)
+			fprintf(f, "\tlw t0, %d(sp)\n\tsw t0, %d(s0)\n", i * 4, i * 4 + 8);
+		fprintf(f, "\tlw t1, 0(s0)\n\taddi sp, s0, 4\n\tmv s0, t1\n\tlw ra, 0(sp)\n\taddi sp, sp, 4\n");
+		break;
+	case ADJ:  rv_addi(f, "sp", "sp", pc[1] * 4); break;
+	case LEV:  fprintf(f, "\tmv sp, s0\n\tlw s0, 0(sp)\n\tlw ra, 4(sp)\n\taddi sp, sp, 8\n\tret\n"); break;
+	case RET:  fprintf(f, "\tlw ra, 0(sp)\n\taddi sp, sp, 4\n\tret\n"); break;
+	case LW:   fprintf(f, "\tlw a0, 0(a0)\n"); break;
+	case LC:   fprintf(f, "\tlb a0, 0(a0)\n"); break;
+	case SW:   fprintf(f, "\tlw t0, 0(sp)\n\taddi sp, sp, 4\n\tsw a0, 0(t0)\n"); break;
+	case SC:   fprintf(f, "\tlw t0, 0(sp)\n\taddi sp, sp, 4\n\tsb a0, 0(t0)\n\tslli a0, a0, 24\n\tsrai a0, a0, 24\n"); break;
+	case PUSH: fprintf(f, "\taddi sp, sp, -4\n\tsw a0, 0(sp)\n"); break;
+	case OPEN: rv_libc(f, "open", 0, 2, 2); break;
+	case READ: rv_libc(f, "read", 0, 3, 3); break;
+	case CLOS: rv_libc(f, "close", 0, 1, 1); break;
+	case PRTF: rv_libc(f, "printf", 0, pc[1] == ADJ ? pc[2] : 1, 6); break;
+	case FPRT:
+		n = pc[1] == ADJ ? pc[2] : 2;
+		fprintf(f, "\tlw t0, %d(sp)\n\tli t1, 2\n\tla a0, stdout\n\tbne t0, t1, 1f\n\tla a0, stderr\n1:\n"
+			"\tlw a0, 0(a0)\n", (n - 1) * 4);
+		rv_libc(f, "fprintf", 1, n - 1, 6);
+		break;
+	case MALC: rv_libc(f, "malloc", 0, 1, 1); break;
+	case MSET: rv_libc(f, "memset", 0, 3, 3); break;
+	case MCMP: rv_libc(f, "memcmp", 0, 3, 3); break;
+	case EXIT: rv_libc(f, "exit", 0, 1, 1); break;
+	default:
+		fprintf(f, "\tlw t0, 0(sp)\n\taddi sp, sp, 4\n");
+		switch (*pc) {
+		case OR:  fprintf(f, "\tor a0, t0, a0\n"); break;
+		case XOR: fprintf(f, "\txor a0, t0, a0\n"); break;
+		case AND: fprintf(f, "\tand a0, t0, a0\n"); break;
+		case EQ:  fprintf(f, "\tsub a0, t0, a0\n\tseqz a0, a0\n"); break;
+		case NEQ: fprintf(f, "\tsub a0, t0, a0\n\tsnez a0, a0\n"); break;
+		case LT:  fprintf(f, "\tslt a0, t0, a0\n"); break;
+		case GT:  fprintf(f, "\tslt a0, a0, t0\n"); break;
+		case LE:  fprintf(f, "\tslt a0, a0, t0\n\txori a0, a0, 1\n"); break;
+		case GE:  fprintf(f, "\tslt a0, t0, a0\n\txori a0, a0, 1\n"); break;
+		case SHL: fprintf(f, "\tsll a0, t0, a0\n"); break;
+		case SHR: fprintf(f, "\tsra a0, t0, a0\n"); break;
+		case ADD: fprintf(f, "\tadd a0, t0, a0\n"); break;
+		case SUB: fprintf(f, "\tsub a0, t0, a0\n"); break;
+		case MUL: fprintf(f, "\tmul a0, t0, a0\n"); break;
+		case DIV: fprintf(f, "\tdiv a0, t0, a0\n"); break;
+		case MOD: fprintf(f, "\trem a0, t0, a0\n"); break;
+		}
+	}
+}
+
+void rv_call(FILE *f, struct ident *d, int tail) {
+	fprintf(f, "\t%s mx_%.*s\n", tail ? "tail" : "call", d->hash & 0x3f, d->name);
+}
+
+/*
+ * rv_word() - load a word the vector loop reads, [kind][value] at v, into r
+ */
+void rv_word(FILE *f, char *r, int *v, char *fp) {
+	if (*v == Num)
+		fprintf(f, "\tli %s, %d\n", r, v[1]);
+	else if (*v == Local)
+		fprintf(f, "\tlw %s, %d(%s)\n", r, v[1] * 4, fp);
+	else {
+		fprintf(f, "\tla %s, ", r);
+		tgt_addr(f, v[1]);
+		fprintf(f, "\n\tlw %s, 0(%s)\n", r, r);
+	}
+}
+
+/*
+ * rv_vec() - the loop a VEC describes, strip-mined with vsetvli
+ *
+ * i is in a1, the bound in a2, the elements left in a7 and the byte offset
+ * of i in a4, base b of the arrays in t<3 + b>. Expression operand k lives
+ * in v<2 + k> and a reduction in element 0 of v1. The loop leaves i at the
+ * bound, so the scalar loop after it only tests its condition, and it is
+ * skipped for the scalar loop to do all the work when a store could change
+ * an element another array reads in a later lane.
+ */
+void rv_vec(FILE *f, int *pc) {
+	static char *vv[] = {"or", "xor", "and", "", "", "", "", "", "", "sll", "sra", "add", "sub", "mul"};
+	int *d, *e, *end, stk[VEC_REGS], top, l, r, id, b;
+	char *fp, *sew, *w;
+
+	d = (int *) pc[1];
+	id = pc - text;
+	fp = d[1] ? "sp" : "s0";
+	sew = d[0] == 1 ? "e8" : "e32";
+	w = d[0] == 1 ? "8" : "32";
+
+	fprintf(f, "\tlw a1, %d(%s)\n", d[2] * 4, fp);
+	rv_word(f, "a2", d + 3, fp);
+	fprintf(f, "\tsub a7, a2, a1\n\tblez a7, .LVe%d\n", id);
+	for (b = 0; b < d[5]; b++)
+		rv_word(f, b == 0 ? "t3" : b == 1 ? "t4" : b == 2 ? "t5" : "t6", d + 6 + b * 2, fp);
+	if (d[14] >= 0 && d[5] > 1) {
+		fprintf(f, "\tslli a4, a7, %d\n", d[0] == 1 ? 0 : 2);
+		for (b = 0; b < d[5]; b++)
+			if (b != d[14])
+				fprintf(f, "\tbgeu t%d, t%d, 1f\n\tadd a5, t%d, a4\n\tbltu t%d, a5, .LVe%d\n1:\n",
+					3 + b, 3 + d[14], 3 + b, 3 + d[14], id);
+	}
+	else if (d[14] < 0)
+		fprintf(f, "\tlw a5, %d(%s)\n\tvsetivli zero, 1, e32, m1, ta, ma\n\tvmv.s.x v1, a5\n", d[16] * 4, fp);
+
+	fprintf(f, ".LV%d:\n\tvsetvli a3, a7, %s, m1, ta, ma\n\tslli a4, a1, %d\n", id, sew, d[0] == 1 ? 0 : 2);
+	top = 0;
+	for (e = d + VEC_HEAD, end = e + d[17]; e < end; ) {
+		switch (*e) {
+		case Load:
+			fprintf(f, "\tadd a5, t%d, a4\n\tvle%s.v v%d, (a5)\n", 3 + e[1], w, 2 + top);
+			stk[top++] = 1;
+			e += 2;
+			break;
+		case Id:
+			fprintf(f, "\tvid.v v%d\n\tvadd.vx v%d, v%d, a1\n", 2 + top, 2 + top, 2 + top);
+			stk[top++] = 1;
+			e += 2;
+			break;
+		case Num:
+		case Local:
+		case Global:
+			// a scalar is loaded where it is used
+			stk[top++] = -(e - d);
+			e += 2;
+			break;
+		default:
+			r = stk[--top];
+			l = stk[--top];
+			if (l < 0 && (r < 0 || *e == Shl || *e == Shr)) {
+				rv_word(f, "a5", d - l, fp);
+				fprintf(f, "\tvmv.v.x v%d, a5\n", 2 + top);
+				l = 1;
+			}
+			if (r < 0) {
+				rv_word(f, "a5", d - r, fp);
+				fprintf(f, "\tv%s.vx v%d, v%d, a5\n", vv[*e - Or], 2 + top, 2 + top);
+			}
+			else if (l < 0) {
+				// a scalar on the left of a commutative op or a subtraction
+				rv_word(f, "a5", d - l, fp);
+				fprintf(f, "\tv%s.vx v%d, v%d, a5\n", *e == Sub ? "rsub" : vv[*e - Or], 2 + top, 3 + top);
+			}
+			else
+				fprintf(f, "\tv%s.vv v%d, v%d, v%d\n", vv[*e - Or], 2 + top, 2 + top, 3 + top);
+			stk[top++] = 1;
+			e++;
+		}
+	}
+	if (stk[0] < 0) {
+		rv_word(f, "a5", d - stk[0], fp);
+		fprintf(f, "\tvmv.v.x v2, a5\n");
+	}
+	if (d[14] >= 0)
+		fprintf(f, "\tadd a5, t%d, a4\n\tvse%s.v v2, (a5)\n", 3 + d[14], w);
+	else
+		fprintf(f, "\tvred%s.vs v1, v2, v1\n", d[15] == Add ? "sum" : vv[d[15] - Or]);
+	fprintf(f, "\tadd a1, a1, a3\n\tsub a7, a7, a3\n\tbnez a7, .LV%d\n\tsw a1, %d(%s)\n", id, d[2] * 4, fp);
+	if (d[14] < 0)
+		fprintf(f, "\tvmv.x.s a5, v1\n\tsw a5, %d(%s)\n", d[16] * 4, fp);
+	fprintf(f, ".LVe%d:\n", id);
+}
+
+/*
+ * RV32 post-lowering optimization. The finished assembly is read back as
+ * instructions, cleaned up by a peephole pass, list scheduled for the
+ * in-order pipeline of rv_model and written out again. Labels, directives,
+ * branches, calls and the vector code end the basic blocks both passes
+ * work in. Between blocks t0-t2 only hold what the lowering of a single
+ * instruction left behind, so they are dead at every block boundary and
+ * free to carry the words the stack code pushes and pops.
+ */
+struct rv_model {
+	// cycles until the result of a load, a mul and a div or rem can be used
+	int load, mul, div;
+	// instructions issued per cycle
+	int issue;
+} rv_model, rv_default = {2, 3, 16, 1};
+
+enum {RV_ALU, RV_MUL, RV_DIV, RV_LOAD, RV_STORE, RV_BAR, RV_RAW};
+enum {RV_ARGS = 6, RV_ARG = 32, RV_BLOCK = 256, RV_NEST = 64};
+// t0-t2, and the registers the passes may rename, which leaves out zero,
+// ra, sp, gp, tp, s0 and s1
+enum {RV_DEAD = 7 << 5, RV_TEMPS = ~0x31f};
+
+struct rv_insn {
+	// the line of a label or a directive, 0 for an instruction
+	char *raw;
+	char op[RV_ARG];
+	char arg[RV_ARGS][RV_ARG];
+	int nargs;
+	int kind;
+	// a bit per x register it reads and writes
+	unsigned use, def;
+	// the base register and the offset of a load or a store
+	int base, off;
+	int gone;
+};
+
+char *rv_names[] = {
+	"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1",
+	"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+	"s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+	"t3", "t4", "t5", "t6"
+};
+
+/*
+ * rv_reg() - the number of the x register named s, or -1
+ */
+int rv_reg(char *s) {
+	int i;
+
+	for (i = 0; i < 32; i++)
+		if (!strcmp(rv_names[i], s))
+			return i;
+	return -1;
+}
+
+/*
+ * rv_mem() - the base register of the memory operand off(reg) in s, or -1
+ */
+int rv_mem(char *s, int *off) {
+	char r[RV_ARG], *e;
+
+	if (!(e = strchr(s, '(')) || strlen(e) >= RV_ARG)
+		return -1;
+	*off = atoi(s);
+	strcpy(r, e + 1);
+	if ((e = strchr(r, ')')))
+		*e = 0;
+	return rv_reg(r);
+}
+
+/*
+ * rv_decode() - find what the instruction in reads and writes
+ */
+void rv_decode(struct rv_insn *in) {
+	static char *alu[] = {
+		"li", "la", "mv", "addi", "andi", "ori", "xori", "slli", "srli", "srai", "slti", "sltiu",
+		"add", "sub", "and", "or", "xor", "sll", "srl", "sra", "slt", "sltu", "seqz", "snez",
+		"mul", "div", "divu", "rem", "remu", 0
+	};
+	int i, k, r;
+
+	in->use = in->def = 0;
+	in->base = -1;
+	in->off = 0;
+	for (k = 0; alu[k] && strcmp(alu[k], in->op); k++)
+		;
+	if (alu[k] && in->nargs) {
+		in->kind = !strcmp(in->op, "mul") ? RV_MUL : k > 24 ? RV_DIV : RV_ALU;
+		if ((r = rv_reg(in->arg[0])) > 0)
+			in->def = 1u << r;
+		for (i = 1; i < in->nargs; i++)
+			if ((r = rv_reg(in->arg[i])) >= 0)
+				in->use |= 1u << r;
+	}
+	else if (in->nargs == 2 && (!strcmp(in->op, "lw") || !strcmp(in->op, "lb") || !strcmp(in->op, "lbu") ||
+				    !strcmp(in->op, "lh") || !strcmp(in->op, "lhu"))) {
+		in->kind = RV_LOAD;
+		if ((r = rv_reg(in->arg[0])) > 0)
+			in->def = 1u << r;
+		if ((in->base = rv_mem(in->arg[1], &in->off)) >= 0)
+			in->use = 1u << in->base;
+	}
+	else if (in->nargs == 2 && (!strcmp(in->op, "sw") || !strcmp(in->op, "sb") || !strcmp(in->op, "sh"))) {
+		in->kind = RV_STORE;
+		if ((r = rv_reg(in->arg[0])) >= 0)
+			in->use = 1u << r;
+		if ((in->base = rv_mem(in->arg[1], &in->off)) >= 0)
+			in->use |= 1u << in->base;
+	}
+	else {
+		// branches, calls and vector code, only what they read matters
+		in->kind = RV_BAR;
+		for (i = 0; i < in->nargs; i++)
+			if ((r = rv_reg(in->arg[i])) >= 0 || (r = rv_mem(in->arg[i], &k)) >= 0)
+				in->use |= 1u << r;
+	}
+	// an unknown memory operand could be anything
+	if ((in->kind == RV_LOAD || in->kind == RV_STORE) && in->base < 0)
+		in->kind = RV_BAR;
+}
+
+/*
+ * rv_set() - make in the instruction op with the nargs arguments in args
+ */
+void rv_set(struct rv_insn *in, char *op, int nargs, char **args) {
+	char arg[RV_ARGS][RV_ARG];
+	int i;
+
+	// the arguments may be those of in
+	for (i = 0; i < nargs; i++)
+		snprintf(arg[i], RV_ARG, "%s", args[i]);
+	strcpy(in->op, op);
+	memcpy(in->arg, arg, nargs * RV_ARG);
+	in->nargs = nargs;
+	rv_decode(in);
+}
+
+/*
+ * rv_next() - the instruction after ins[i] that is still there, or n
+ */
+int rv_next(struct rv_insn *ins, int n, int i) {
+	while (++i < n && ins[i].gone)
+		;
+	return i;
+}
+
+/*
+ * rv_dead() - whether the value register r has after ins[i] is never read
+ */
+int rv_dead(struct rv_insn *ins, int n, int i, int r) {
+	for (i = rv_next(ins, n, i); i < n; i = rv_next(ins, n, i)) {
+		if (ins[i].use & 1u << r)
+			return 0;
+		if (ins[i].kind >= RV_BAR)
+			break;
+		if (ins[i].def & 1u << r)
+			return 1;
+	}
+	return RV_DEAD >> r & 1;
+}
+
+/*
+ * rv_width() - the bytes a load or a store accesses
+ */
+int rv_width(struct rv_insn *in) {
+	return in->op[1] == 'w' ? 4 : in->op[1] == 'h' ? 2 : 1;
+}
+
+/*
+ * rv_pushpop() - keep the words the stack code pushes and pops again
+ * in the same block in t0-t2
+ *
+ * A push is addi sp, sp, -4 and sw a0, 0(sp), a pop lw t0, 0(sp) and
+ * addi sp, sp, 4. Between a push and the pop that matches it nothing else
+ * may touch sp, then the word moves through one of t0-t2 the instructions
+ * in between leave alone. Inner pairs go first, so an expression nests as
+ * deep as there are free registers.
+ */
+void rv_pushpop(struct rv_insn *ins, int n) {
+	int push[RV_NEST], top, i, j, k, r;
+	unsigned busy;
+
+	top = 0;
+	for (i = 0; i + 1 < n; i++) {
+		if (ins[i].gone)
+			continue;
+		if (ins[i].kind >= RV_BAR) {
+			top = 0;
+			continue;
+		}
+		if (!strcmp(ins[i].op, "addi") && !strcmp(ins[i].arg[0], "sp") && !strcmp(ins[i].arg[1], "sp") &&
+		    !strcmp(ins[i].arg[2], "-4") && !strcmp(ins[i + 1].op, "sw") && !strcmp(ins[i + 1].arg[0], "a0") &&
+		    !strcmp(ins[i + 1].arg[1], "0(sp)")) {
+			if (top == RV_NEST)
+				top = 0;
+			push[top++] = i++;
+			continue;
+		}
+		if (top && !strcmp(ins[i].op, "lw") && !strcmp(ins[i].arg[0], "t0") && !strcmp(ins[i].arg[1], "0(sp)") &&
+		    !strcmp(ins[i + 1].op, "addi") && !strcmp(ins[i + 1].arg[0], "sp") && !strcmp(ins[i + 1].arg[1], "sp") &&
+		    !strcmp(ins[i + 1].arg[2], "4")) {
+			j = push[--top];
+			busy = 0;
+			for (k = j + 2; k < i; k++)
+				if (!ins[k].gone)
+					busy |= ins[k].use | ins[k].def;
+			for (r = 5; r < 8 && busy & 1u << r; r++)
+				;
+			if (r == 8) {
+				// the word stays on the stack, and so does every outer one
+				top = 0;
+				i++;
+				continue;
+			}
+			rv_set(&ins[j], "mv", 2, (char *[]) {rv_names[r], "a0"});
+			ins[j + 1].gone = 1;
+			if (r == 5)
+				ins[i].gone = 1;
+			else
+				rv_set(&ins[i], "mv", 2, (char *[]) {"t0", rv_names[r]});
+			ins[++i].gone = 1;
+			continue;
+		}
+		if ((ins[i].use | ins[i].def) & 1u << 2)
+			top = 0;
+	}
+}
+
+/*
+ * rv_rename() - make the instruction in read register s where it reads d
+ */
+void rv_rename(struct rv_insn *in, int d, int s) {
+	char mem[RV_ARG];
+	int i;
+
+	for (i = in->kind == RV_STORE ? 0 : 1; i < in->nargs; i++)
+		if (rv_reg(in->arg[i]) == d)
+			strcpy(in->arg[i], rv_names[s]);
+	if ((in->kind == RV_LOAD || in->kind == RV_STORE) && in->base == d) {
+		snprintf(mem, RV_ARG, "%d(%s)", in->off, rv_names[s]);
+		strcpy(in->arg[1], mem);
+	}
+	rv_decode(in);
+}
+
+/*
+ * rv_move() - drop the move ins[i]: to itself, back after the move the
+ * other way, or by having the instruction before it write its destination
+ * or the one after it read its source instead
+ */
+int rv_move(struct rv_insn *ins, int n, int i) {
+	int d, s, j;
+
+	d = rv_reg(ins[i].arg[0]);
+	s = rv_reg(ins[i].arg[1]);
+	if (d < 0 || s < 0)
+		return 0;
+	if (d == s) {
+		ins[i].gone = 1;
+		return 1;
+	}
+	j = rv_next(ins, n, i);
+	if (j < n && !strcmp(ins[j].op, "mv") && rv_reg(ins[j].arg[0]) == s && rv_reg(ins[j].arg[1]) == d) {
+		ins[j].gone = 1;
+		return 1;
+	}
+	if (!(RV_TEMPS >> d & 1) || !(RV_TEMPS >> s & 1))
+		return 0;
+
+	// the value of s is made for the move alone
+	if (rv_dead(ins, n, i, s)) {
+		for (j = i - 1; j >= 0 && (ins[j].gone || ins[j].kind < RV_BAR); j--) {
+			if (ins[j].gone)
+				continue;
+			if ((ins[j].use | ins[j].def) & 1u << d)
+				break;
+			if (ins[j].def & 1u << s) {
+				strcpy(ins[j].arg[0], rv_names[d]);
+				rv_decode(&ins[j]);
+				ins[i].gone = 1;
+				return 1;
+			}
+			if (ins[j].use & 1u << s)
+				break;
+		}
+	}
+
+	// d is read once, while s still holds the same
+	for (j = rv_next(ins, n, i); j < n && ins[j].kind < RV_BAR; j = rv_next(ins, n, j)) {
+		if (ins[j].use & 1u << d) {
+			if (!(ins[j].def & 1u << d) && !rv_dead(ins, n, j, d))
+				return 0;
+			rv_rename(&ins[j], d, s);
+			ins[i].gone = 1;
+			return 1;
+		}
+		if (ins[j].def & (1u << d | 1u << s))
+			return 0;
+	}
+	return 0;
+}
+
+/*
+ * rv_fold() - fold the addi ins[i] into the offset of the load or store
+ * that uses its result as the base
+ */
+int rv_fold(struct rv_insn *ins, int n, int i) {
+	char mem[RV_ARG];
+	int t, b, v, j;
+
+	t = rv_reg(ins[i].arg[0]);
+	b = rv_reg(ins[i].arg[1]);
+	v = atoi(ins[i].arg[2]);
+	if (t < 0 || b < 0 || !(RV_TEMPS >> t & 1))
+		return 0;
+	for (j = rv_next(ins, n, i); j < n && ins[j].kind < RV_BAR; j = rv_next(ins, n, j)) {
+		if (!((ins[j].use | ins[j].def) & 1u << t)) {
+			if (ins[j].def & 1u << b)
+				return 0;
+			continue;
+		}
+		if ((ins[j].kind != RV_LOAD && ins[j].kind != RV_STORE) || ins[j].base != t ||
+		    (ins[j].kind == RV_STORE && rv_reg(ins[j].arg[0]) == t) ||
+		    ins[j].off + v < -2048 || ins[j].off + v >= 2048)
+			return 0;
+		if (!(ins[j].def & 1u << t) && !rv_dead(ins, n, j, t))
+			return 0;
+		snprintf(mem, RV_ARG, "%d(%s)", ins[j].off + v, rv_names[b]);
+		strcpy(ins[j].arg[1], mem);
+		rv_decode(&ins[j]);
+		ins[i].gone = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * rv_forward() - turn a load of the stack slot the sw ins[i] stored to
+ * into a move of the register it stored
+ */
+int rv_forward(struct rv_insn *ins, int n, int i) {
+	int s, j;
+
+	s = rv_reg(ins[i].arg[0]);
+	if (s < 0 || (ins[i].base != 2 && ins[i].base != 8))
+		return 0;
+	for (j = rv_next(ins, n, i); j < n && ins[j].kind < RV_BAR; j = rv_next(ins, n, j)) {
+		if (!strcmp(ins[j].op, "lw") && ins[j].base == ins[i].base && ins[j].off == ins[i].off) {
+			rv_set(&ins[j], "mv", 2, (char *[]) {ins[j].arg[0], rv_names[s]});
+			return 1;
+		}
+		// another slot of the same frame is known not to overlap
+		if (ins[j].kind == RV_STORE && (ins[j].base != ins[i].base ||
+		    (ins[j].off < ins[i].off + 4 && ins[i].off < ins[j].off + rv_width(&ins[j]))))
+			return 0;
+		if (ins[j].def & (1u << s | 1u << ins[i].base))
+			return 0;
+	}
+	return 0;
+}
+
+/*
+ * rv_branch() - whether the jump or branch ins[i] goes to the next instruction
+ */
+int rv_branch(struct rv_insn *ins, int n, int i) {
+	char *l;
+	int j, k;
+
+	if (ins[i].op[0] != 'j' && ins[i].op[0] != 'b')
+		return 0;
+	l = ins[i].arg[ins[i].nargs - 1];
+	k = strlen(l);
+	for (j = rv_next(ins, n, i); j < n && ins[j].raw && ins[j].raw[0] == '.'; j = rv_next(ins, n, j))
+		if (!strncmp(ins[j].raw, l, k) && !strcmp(ins[j].raw + k, ":"))
+			return 1;
+	return 0;
+}
+
+/*
+ * rv_peephole() - run the rewrites until none applies
+ */
+void rv_peephole(struct rv_insn *ins, int n) {
+	struct rv_insn *in;
+	int i, more;
+
+	do {
+		more = 0;
+		for (i = 0; i < n; i++) {
+			in = &ins[i];
+			if (in->gone || in->raw)
+				continue;
+			if (in->kind == RV_BAR) {
+				if (in->nargs && rv_branch(ins, n, i))
+					more = in->gone = 1;
+				continue;
+			}
+			if (!strcmp(in->op, "mv"))
+				more |= rv_move(ins, n, i);
+			else if (!strcmp(in->op, "addi") && rv_reg(in->arg[0]) == rv_reg(in->arg[1]) && !atoi(in->arg[2]))
+				more = in->gone = 1;
+			else if (!strcmp(in->op, "addi"))
+				more |= rv_fold(ins, n, i);
+			else if (!strcmp(in->op, "sw"))
+				more |= rv_forward(ins, n, i);
+			// a value nothing reads
+			if (!in->gone && in->kind != RV_STORE && in->def & RV_TEMPS && rv_dead(ins, n, i, rv_reg(in->arg[0])))
+				more = in->gone = 1;
+		}
+	} while (more);
+}
+
+/*
+ * rv_latency() - the cycles until the result of in can be used
+ */
+int rv_latency(struct rv_insn *in) {
+	return in->kind == RV_LOAD ? rv_model.load : in->kind == RV_MUL ? rv_model.mul :
+	       in->kind == RV_DIV ? rv_model.div : 1;
+}
+
+/*
+ * rv_block() - list schedule the m instructions ins[blk[0..m)] of a block
+ *
+ * dep[a * m + b] is one more than the cycles b has to issue after a. Of
+ * the instructions whose operands are ready, the one with the longest
+ * path to the end of the block issues first, so loads and multiplies
+ * start early and independent work fills their latency.
+ */
+void rv_block(struct rv_insn *ins, int *blk, int m, unsigned char *dep) {
+	struct rv_insn *a, *b, tmp[RV_BLOCK];
+	int height[RV_BLOCK], ready[RV_BLOCK], preds[RV_BLOCK], order[RV_BLOCK];
+	int i, j, k, c, l, cycle, done, issued, best;
 
+	memset(dep, 0, m * m);
+	memset(preds, 0, m * sizeof(int));
+	for (j = 0; j < m; j++) {
+		b = &ins[blk[j]];
+		for (i = 0; i < j; i++) {
+			a = &ins[blk[i]];
+			l = -1;
+			if (a->def & b->use)
+				l = rv_latency(a);
+			if (a->def & b->def && l < 1)
+				l = 1;
+			if (a->use & b->def && l < 0)
+				l = 0;
+			// two accesses to memory, unless they hit other bytes off the same base
+			if ((a->kind == RV_STORE && (b->kind == RV_LOAD || b->kind == RV_STORE)) ||
+			    (a->kind == RV_LOAD && b->kind == RV_STORE)) {
+				k = a->base == b->base && (a->off + rv_width(a) <= b->off || b->off + rv_width(b) <= a->off);
+				for (c = i + 1; k && c < j; c++)
+					if (ins[blk[c]].def & 1u << a->base)
+						k = 0;
+				if (!k && l < 1)
+					l = 1;
+			}
+			// no red zone, a frame slot is only safe above sp
+			if (((a->def & 1u << 2) && b->kind >= RV_LOAD) || (a->kind >= RV_LOAD && (b->def & 1u << 2)))
+				if (l < 0)
+					l = 0;
+			if (l >= 0) {
+				dep[i * m + j] = l > 254 ? 255 : l + 1;
+				preds[j]++;
+			}
 		}
+	}
+	for (i = m - 1; i >= 0; i--) {
+		height[i] = rv_latency(&ins[blk[i]]);
+		for (j = i + 1; j < m; j++)
+			if (dep[i * m + j] && dep[i * m + j] - 1 + height[j] > height[i])
+				height[i] = dep[i * m + j] - 1 + height[j];
+		ready[i] = 0;
+	}
 
-		match_token(';');
-		return;
-	case Int:
-	case Char:
-	case Struct:
-	case Union:
-		type = token;
-		switch(token) {
-		case Struct:
-		case Union:
-			i = 0;
-			struct_token = token;
-			next();
-			if (token != Id) 
-				err_exit("error - expected identifier");
-			if (!id->struct_type)
-				id->struct_type = type_new++;
-			type = type_new;
-			decl_type = type_new;
-			if (token == '{') {
-				type_size[decl_type] = 0;
-				i = 0;
-				if (members[decl_type])
-					err_exit("error - duplicate structure definition\n");
-				while(token != '}') {
-					next();
-					member_type = INT;
-					switch (token) {
-					case Int:
-						next();
-						break;
-					case Char:
-						next();
-						member_type = CHAR;
-						break;
-					case Struct:
-					case Union:
-						next();
-						if (token != Id)
-							err_exit("error - bad struct/union declaration\n");
-						member_type = id->struct_type;
-						next();
-						break;
-					}
-					
-					while (token != ';') {
-						expr_type = member_type;
-						while (token == Mul) {
-							expr_type += PTR;
-							next();
-						}
-		
-						if (token != Id) {
-							err_exit("error - expected identifier\n");
-						}
-						
-						m = malloc(sizeof(struct struct_member));
-						m->id = id;
-						m->offset = i;
-						m->type = expr_type;
-						m->next = members[decl_type];
-						members[decl_type] = m;
-						i = i + (decl_type >= PTR) ? sizeof(int) : type_size[decl_type];
-						i = (i + 3) & -4;
-						if (struct_token == Union) {
-							if (i > type_size[decl_type])
-								type_size[decl_type] = i;
-							i = 0;
-						}
-						next();
-						if (token == ',')
-							next();
-					}
-					next();
+	for (cycle = done = 0; done < m; cycle++) {
+		for (issued = 0; issued < rv_model.issue; issued++) {
+			best = -1;
+			for (j = 0; j < m; j++)
+				if (!preds[j] && ready[j] <= cycle && (best < 0 || height[j] > height[best]))
+					best = j;
+			if (best < 0)
+				break;
+			order[done++] = best;
+			preds[best] = -1;
+			for (j = best + 1; j < m; j++) {
+				if (dep[best * m + j]) {
+					preds[j]--;
+					if (cycle + dep[best * m + j] - 1 > ready[j])
+						ready[j] = cycle + dep[best * m + j] - 1;
 				}
-				match_token('}');
-				if (struct_token != Union)
-					type_size[decl_type] = i;
 			}
-			break;
-		case Int:
-		case Char:
-			decl_type = (token == Int) ? INT : CHAR;
-			next();
-			break;
 		}
+	}
 
-		if ((type == Int || type == Char) && token == ';') {
-			err_exit("bad global declaration\n");
+	for (i = 0; i < m; i++)
+		tmp[i] = ins[blk[order[i]]];
+	for (i = 0; i < m; i++)
+		ins[blk[i]] = tmp[i];
+}
+
+/*
+ * rv_schedule() - list schedule every basic block
+ */
+void rv_schedule(struct rv_insn *ins, int n, unsigned char *dep) {
+	int blk[RV_BLOCK], m, i;
+
+	m = 0;
+	for (i = 0; i <= n; i++) {
+		if (i < n && ins[i].gone)
+			continue;
+		if (i < n && ins[i].kind < RV_BAR && m < RV_BLOCK) {
+			blk[m++] = i;
+			continue;
 		}
-		
-		while (token != ';' && token != '}') {
-			expr_type = decl_type;
-			while (token == Mul) {
-				expr_type = expr_type + PTR;
-				next();
-			}
+		if (m > 1)
+			rv_block(ins, blk, m, dep);
+		m = 0;
+		if (i < n && ins[i].kind < RV_BAR)
+			blk[m++] = i;
+	}
+}
 
-			if (token != Id) {
-				err_exit("error - expected identifier\n");
-			}
-			next();
+/*
+ * rv_parse() - read the instruction on line s into in, 0 when s is a label,
+ * a directive or has more operands than an rv_insn holds
+ */
+int rv_parse(struct rv_insn *in, char *s) {
+	int i;
 
-			if (token == '(') {
-				id->class = Func;
-				id->val = (int) (text_p + 1);
-				// TODO: parse function parameters and definition
-				// parse parameters
-				next();
-				while (token != ')') {
-					type = INT;
-					switch (token) {
-					case Int:
-						next();
-						break;
-					case Char:
-						next();
-						type = Char;
-						break;
-					case Struct:
-					case Union:
-						next();
-						if (token != Id)
-							err_exit("error - bad struct type for parameter\n");
-						type = id->struct_type;
-						next();
-						break;
-					}
-					
-					while (token == Mul) {
-						type = type + PTR;
-						next();
-					}
+	if (*s++ != '\t' || *s == '.')
+		return 0;
+	for (i = 0; *s && *s != ' '; s++) {
+		if (i == RV_ARG - 1)
+			return 0;
+		in->op[i++] = *s;
+	}
+	while (*s == ' ')
+		s++;
+	while (*s) {
+		if (in->nargs == RV_ARGS)
+			return 0;
+		for (i = 0; *s && *s != ','; s++) {
+			if (i == RV_ARG - 1)
+				return 0;
+			in->arg[in->nargs][i++] = *s;
+		}
+		in->nargs++;
+		while (*s == ',' || *s == ' ')
+			s++;
+	}
+	rv_decode(in);
+	return 1;
+}
 
-					if (token != Id) {
-						err_exit("error - bad parameter declaration\n");
-					}
+/*
+ * rv_post() - optimize the RV32 assembly in *buf, 1 when out of memory
+ */
+int rv_post(char **buf, size_t *len) {
+	struct rv_insn *ins, *in;
+	unsigned char *dep;
+	char *s, *e, *out;
+	size_t out_len;
+	FILE *f;
+	int i, k, n;
 
-					if (id->class == Local) {
-						err_exit("error - duplicate parameter declaration\n");
-					}
+	for (n = 1, s = *buf; s < *buf + *len; s++)
+		n += *s == '\n';
+	dep = 0;
+	if (!(ins = calloc(n, sizeof(struct rv_insn))) || !(dep = malloc(RV_BLOCK * RV_BLOCK))) {
+		free(ins);
+		return 1;
+	}
+	for (n = 0, s = *buf; s < *buf + *len; s = e + 1, n++) {
+		if (!(e = memchr(s, '\n', *buf + *len - s)))
+			e = *buf + *len;
+		*e = 0;
+		if (!rv_parse(&ins[n], s)) {
+			memset(&ins[n], 0, sizeof(struct rv_insn));
+			ins[n].raw = s;
+			ins[n].kind = RV_RAW;
+		}
+	}
 
-					if (token != Id) 
-						err_exit("error - expected identifier");
+	rv_pushpop(ins, n);
+	rv_peephole(ins, n);
+	rv_schedule(ins, n, dep);
 
-					id->hclass = id->class;
-					id->class = Local;
+	if (!(f = open_memstream(&out, &out_len))) {
+		free(ins);
+		free(dep);
+		return 1;
+	}
+	for (i = 0; i < n; i++) {
+		in = &ins[i];
+		if (in->gone)
+			continue;
+		if (in->raw) {
+			fprintf(f, "%s\n", in->raw);
+			continue;
+		}
+		fprintf(f, "\t%s", in->op);
+		for (k = 0; k < in->nargs; k++)
+			fprintf(f, "%s%s", k ? ", " : " ", in->arg[k]);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	free(ins);
+	free(dep);
+	free(*buf);
+	*buf = out;
+	*len = out_len;
+	return 0;
+}
 
-					id->htype = id->type;
-					id->type = type;
-					
-					id->hval = id->val;
-					id->val = params++;
+/*
+ * x86_64 keeps a word of the stack in 8 bytes but a word of memory in 4,
+ * the width ints and pointers have in the VM. Pointers therefore have to
+ * stay below 2GB: the program is linked -no-pie, main() moves to a stack in
+ * .bss, malloc() is kept from mmap() and argv is copied to the heap.
+ */
+void x64_begin(FILE *f) {
+	fprintf(f, "\t.text\n\t.globl main\nmain:\n"
+		"\tpushq %%rbx\n\tpushq %%rbp\n\tpushq %%r12\n\tpushq %%r13\n\tpushq %%r14\n\tpushq %%r15\n\tsubq $8, %%rsp\n"
+		"\tmovl %%edi, %%ebx\n\tmovq %%rsi, %%r13\n"
+		"\tmovl $-4, %%edi\n\txorl %%esi, %%esi\n\tcall mallopt\n"
+		"\tleal 4(,%%rbx,4), %%edi\n\tcall malloc\n\tmovq %%rax, %%r14\n"
+		"\txorl %%r15d, %%r15d\n"
+		"1:\tcmpl %%ebx, %%r15d\n\tjge 2f\n"
+		"\tmovq (%%r13,%%r15,8), %%rdi\n\tcall strdup\n\tmovl %%eax, (%%r14,%%r15,4)\n\tincl %%r15d\n\tjmp 1b\n"
+		"2:\tmovl $0, (%%r14,%%r15,4)\n"
+		"\tmovq %%rsp, %%r12\n\tmovq $mx_stack+1048576, %%rsp\n"
+		"\tpushq %%rbx\n\tpushq %%r14\n\tcall mx_main\n"
+		"\tmovq %%r12, %%rsp\n"
+		"\taddq $8, %%rsp\n\tpopq %%r15\n\tpopq %%r14\n\tpopq %%r13\n\tpopq %%r12\n\tpopq %%rbp\n\tpopq %%rbx\n\tret\n"
+		"\t.lcomm mx_stack, 1048576\n");
+}
 
-					next();
-					if (token == ',')
-						match_token(',');
-				}
-				idx_of_bp = params + 1;
-				next();
+void x64_entry(FILE *f) {
+}
 
-				old_text = text_p;
-				
-				stmt(Func);
-				id = sym;
-
-				// clear id table for local variable and label
-				while (id->token) {
-					if (id->class == Local) {
-						id->class = id->hclass;
-						id->type = id->htype;
-						id->val = id->hval;
-					}
-					else if (id->class == Label) {
-						id->class = 0;
-						id->type = 0;
-						id->val = 0;
-					}
-					id++;
-				}
-			}
-			else {
-				id->class = Global;
-				id->val = (int)(data_p);
-				if (expr_type < PTR)
-					data_p = data_p + type_size[decl_type];
-				else
-					data_p = data_p + sizeof(int);
-				if (token == ',')
-					match_token(',');
+/*
+ * x64_libc() - call fn with the syscall arguments at (n - 1 - i) slots
+ * above rsp in the argument registers from the first one on
+ */
+void x64_libc(FILE *f, char *fn, int first, int n, int cnt) {
+	static char *regs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+	int i;
 
-			}
+	for (i = 0; i < cnt; i++)
+		fprintf(f, "\tmovq %d(%%rsp), %%%s\n", (n - 1 - i) * 8, regs[i + first]);
+	fprintf(f, "\tmovq %%rsp, %%rbx\n\tandq $-16, %%rsp\n\txorl %%eax, %%eax\n\tcall %s\n\tmovq %%rbx, %%rsp\n\tcltq\n", fn);
+}
+
+void x64_op(FILE *f, int *pc) {
+	int i, n;
+
+	switch (*pc) {
+	case LEA:  fprintf(f, "\tleaq %d(%%rbp), %%rax\n", pc[1] * 8); break;
+	case LEAS: fprintf(f, "\tleaq %d(%%rsp), %%rax\n", pc[1] * 8); break;
+	case IMM:  fprintf(f, "\tmovq $%d, %%rax\n", pc[1]); break;
+	case IMMD:
+		fprintf(f, "\tmovq $");
+		tgt_addr(f, pc[1]);
+		fprintf(f, ", %%rax\n");
+		break;
+	case JMP:  fprintf(f, "\tjmp .L%d\n", (int *) pc[1] - text); break;
+	case BZ:   fprintf(f, "\ttestl %%eax, %%eax\n\tjz .L%d\n", (int *) pc[1] - text); break;
+	case BNZ:  fprintf(f, "\ttestl %%eax, %%eax\n\tjnz .L%d\n", (int *) pc[1] - text); break;
+	case ENT:  fprintf(f, "\tpushq %%rbp\n\tmovq %%rsp, %%rbp\n\tsubq $%d, %%rsp\n", pc[1] * 8); break;
+	case TAIL:
+		for (i = 0; i < pc[1]; i++)
+			fprintf(f, "\tmovq %d(%%rsp), %%rcx\n\tmovq %%rcx, %d(%%rbp)\n", i * 8, i * 8 + 16);
+		fprintf(f, "\tmovq (%%rbp), %%rcx\n\tleaq 8(%%rbp), %%rsp\n\tmovq %%rcx, %%rbp\n");
+		break;
+	case ADJ:  fprintf(f, "\taddq $%d, %%rsp\n", pc[1] * 8); break;
+	case LEV:  fprintf(f, "\tleave\n\tret\n"); break;
+	case RET:  fprintf(f, "\tret\n"); break;
+	case LW:   fprintf(f, "\tmovslq (%%rax), %%rax\n"); break;
+	case LC:   fprintf(f, "\tmovsbq (%%rax), %%rax\n"); break;
+	case SW:   fprintf(f, "\tpopq %%rcx\n\tmovl %%eax, (%%rcx)\n"); break;
+	case SC:   fprintf(f, "\tpopq %%rcx\n\tmovb %%al, (%%rcx)\n\tmovsbq %%al, %%rax\n"); break;
+	case PUSH: fprintf(f, "\tpushq %%rax\n"); break;
+	case OPEN: x64_libc(f, "open", 0, 2, 2); break;
+	case READ: x64_libc(f, "read", 0, 3, 3); break;
+	case CLOS: x64_libc(f, "close", 0, 1, 1); break;
+	case PRTF: x64_libc(f, "printf", 0, pc[1] == ADJ ? pc[2] : 1, 6); break;
+	case FPRT:
+		n = pc[1] == ADJ ? pc[2] : 2;
+		// fprintf() takes five values after the format in registers, the sixth on the stack
+		fprintf(f, "\tmovq stdout(%%rip), %%rdi\n\tcmpq $2, %d(%%rsp)\n\tcmove stderr(%%rip), %%rdi\n"
+			"\tmovq %%rsp, %%rbx\n\tmovq %d(%%rsp), %%rax\n\tandq $-16, %%rsp\n\tsubq $8, %%rsp\n\tpushq %%rax\n"
+			"\tmovq %d(%%rbx), %%rsi\n\tmovq %d(%%rbx), %%rdx\n\tmovq %d(%%rbx), %%rcx\n"
+			"\tmovq %d(%%rbx), %%r8\n\tmovq %d(%%rbx), %%r9\n"
+			"\txorl %%eax, %%eax\n\tcall fprintf\n\tmovq %%rbx, %%rsp\n\tcltq\n",
+			(n - 1) * 8, (n - 7) * 8, (n - 2) * 8, (n - 3) * 8, (n - 4) * 8, (n - 5) * 8, (n - 6) * 8);
+		break;
+	case MALC: x64_libc(f, "malloc", 0, 1, 1); break;
+	case MSET: x64_libc(f, "memset", 0, 3, 3); break;
+	case MCMP: x64_libc(f, "memcmp", 0, 3, 3); break;
+	case EXIT: x64_libc(f, "exit", 0, 1, 1); break;
+	default:
+		// 32 bit arithmetic on the left operand in ecx and the right one in eax
+		fprintf(f, "\tpopq %%rcx\n");
+		switch (*pc) {
+		case OR:  fprintf(f, "\torq %%rcx, %%rax\n"); break;
+		case XOR: fprintf(f, "\txorq %%rcx, %%rax\n"); break;
+		case AND: fprintf(f, "\tandq %%rcx, %%rax\n"); break;
+		case EQ:  fprintf(f, "\tcmpl %%eax, %%ecx\n\tsete %%al\n\tmovzbq %%al, %%rax\n"); break;
+		case NEQ: fprintf(f, "\tcmpl %%eax, %%ecx\n\tsetne %%al\n\tmovzbq %%al, %%rax\n"); break;
+		case LT:  fprintf(f, "\tcmpl %%eax, %%ecx\n\tsetl %%al\n\tmovzbq %%al, %%rax\n"); break;
+		case GT:  fprintf(f, "\tcmpl %%eax, %%ecx\n\tsetg %%al\n\tmovzbq %%al, %%rax\n"); break;
+		case LE:  fprintf(f, "\tcmpl %%eax, %%ecx\n\tsetle %%al\n\tmovzbq %%al, %%rax\n"); break;
+		case GE:  fprintf(f, "\tcmpl %%eax, %%ecx\n\tsetge %%al\n\tmovzbq %%al, %%rax\n"); break;
+		case SHL: fprintf(f, "\txchgq %%rax, %%rcx\n\tshll %%cl, %%eax\n\tcltq\n"); break;
+		case SHR: fprintf(f, "\txchgq %%rax, %%rcx\n\tsarl %%cl, %%eax\n\tcltq\n"); break;
+		case ADD: fprintf(f, "\taddl %%ecx, %%eax\n\tcltq\n"); break;
+		case SUB: fprintf(f, "\tsubl %%eax, %%ecx\n\tmovslq %%ecx, %%rax\n"); break;
+		case MUL: fprintf(f, "\timull %%ecx, %%eax\n\tcltq\n"); break;
+		case DIV: fprintf(f, "\txchgq %%rax, %%rcx\n\tcltd\n\tidivl %%ecx\n\tcltq\n"); break;
+		case MOD: fprintf(f, "\txchgq %%rax, %%rcx\n\tcltd\n\tidivl %%ecx\n\tmovslq %%edx, %%rax\n"); break;
 		}
 	}
-	next();
 }
 
-void program() {
-	next();
-	while (token > 0) {
-		parse_global_decl();
+void x64_call(FILE *f, struct ident *d, int tail) {
+	fprintf(f, "\t%s mx_%.*s\n", tail ? "jmp" : "call", d->hash & 0x3f, d->name);
+}
+
+/*
+ * arm_enc() - whether v is a Thumb-2 modified immediate: a byte, a byte
+ * repeated in the halfwords or in every byte, or 1bcdefgh rotated
+ */
+int arm_enc(int v) {
+	unsigned u, b;
+	int i;
+
+	u = v;
+	b = u & 0xff;
+	if (u == b || u == (b | b << 16) || u == (b << 8 | b << 24) || u == b * 0x01010101)
+		return 1;
+	for (i = 8; i < 32; i++)
+		if (!((u << i | u >> (32 - i)) & ~0xff) && ((u << i | u >> (32 - i)) & 0x80))
+			return 1;
+	return 0;
+}
+
+/*
+ * arm_li() - load v into register r
+ */
+void arm_li(FILE *f, char *r, int v) {
+	if (v >= 0 && v < 256 && !r[2] && r[1] < '8')
+		fprintf(f, "\tmovs %s, #%d\n", r, v);
+	else if (arm_enc(v))
+		fprintf(f, "\tmov %s, #%d\n", r, v);
+	else if (arm_enc(~v))
+		fprintf(f, "\tmvn %s, #%d\n", r, ~v);
+	else if (v >= 0 && v < 65536)
+		fprintf(f, "\tmovw %s, #%d\n", r, v);
+	else
+		fprintf(f, "\tmovw %s, #%d\n\tmovt %s, #%d\n", r, v & 0xffff, r, (unsigned) v >> 16);
+}
+
+/*
+ * arm_addi() - rd = rn + v, the narrow forms for sp are left to the
+ * assembler
+ */
+void arm_addi(FILE *f, char *rd, char *rn, int v) {
+	if (v >= 0 && (arm_enc(v) || v < 4096))
+		fprintf(f, "\tadd%s %s, %s, #%d\n", arm_enc(v) ? "" : "w", rd, rn, v);
+	else if (v < 0 && (arm_enc(-v) || -v < 4096))
+		fprintf(f, "\tsub%s %s, %s, #%d\n", arm_enc(-v) ? "" : "w", rd, rn, -v);
+	else {
+		arm_li(f, "r12", v);
+		fprintf(f, "\tadd %s, %s, r12\n", rd, rn);
 	}
 }
 
-int main(int argc, char **argv) {
+void arm_begin(FILE *f) {
+	// r4 keeps sp while the stack is aligned for a call into libc
+	fprintf(f, "\t.arch armv7-a\n\t.syntax unified\n\t.thumb\n\t.text\n\t.globl main\n\t.thumb_func\nmain:\n"
+		"\tpush {r4, r7, lr}\n\tsub sp, sp, #8\n\tstr r0, [sp, #4]\n\tstr r1, [sp]\n"
+		"\tbl mx_main\n\tadd sp, sp, #8\n\tpop {r4, r7, pc}\n");
+}
+
+void arm_entry(FILE *f) {
+	fprintf(f, "\tpush {lr}\n");
+}
 
-	int *ast;
+/*
+ * arm_libc() - call fn with the syscall arguments at (n - 1 - i) words
+ * above sp in r<i + first>, the ones past r3 go on the stack
+ */
+void arm_libc(FILE *f, char *fn, int first, int n, int cnt) {
 	int i;
-	struct ident *id_main;
 
-	dump_ir = 0;
-	type_new = 0;
+	fprintf(f, "\tmov r4, sp\n\tmov r12, sp\n\tbic r12, r12, #7\n");
+	if (cnt + first > 4) {
+		fprintf(f, "\tsub r12, r12, #%d\n", ((cnt + first - 4) * 4 + 7) & ~7);
+		for (i = 4 - first; i < cnt; i++)
+			fprintf(f, "\tldr r1, [r4, #%d]\n\tstr r1, [r12, #%d]\n", (n - 1 - i) * 4, (i + first - 4) * 4);
+	}
+	fprintf(f, "\tmov sp, r12\n");
+	for (i = 0; i < cnt && i + first < 4; i++)
+		fprintf(f, "\tldr r%d, [r4, #%d]\n", i + first, (n - 1 - i) * 4);
+	fprintf(f, "\tbl %s\n\tmov sp, r4\n", fn);
+}
 
-	--argc; ++argv;
-	if (argc > 0 && !strcmp(*argv, "--dump-ir")) {
-		// TODO
-		--argc; ++argv;
-		dump_ir = 1;
+/*
+ * The ARM output is Thumb-2 with r7 as the frame pointer, which keeps the
+ * pushes and pops of frames in 16 bits. Only the calls into libc and the
+ * main() wrapper follow the AAPCS, an mx_ function takes its arguments
+ * from the stack like the VM code it is lowered from, not from r0-r3. ax is r0 and the left operand is
+ * popped into r1, so the arithmetic takes the 16 bit flag setting forms,
+ * which nothing depends on: a compare is always right before its branch
+ * or IT block.
+ */
+void arm_op(FILE *f, int *pc) {
+	static char *cc[] = {"eq", "ne", "lt", "gt", "le", "ge"};
+	static char *inv[] = {"ne", "eq", "ge", "le", "gt", "lt"};
+	int i, n;
+
+	switch (*pc) {
+	case LEA:  arm_addi(f, "r0", "r7", pc[1] * 4); break;
+	case LEAS: arm_addi(f, "r0", "sp", pc[1] * 4); break;
+	case IMM:  arm_li(f, "r0", pc[1]); break;
+	case IMMD:
+		fprintf(f, "\tmovw r0, #:lower16:");
+		tgt_addr(f, pc[1]);
+		fprintf(f, "\n\tmovt r0, #:upper16:");
+		tgt_addr(f, pc[1]);
+		fprintf(f, "\n");
+		break;
+	case JMP:  fprintf(f, "\tb .L%d\n", (int *) pc[1] - text); break;
+	case BZ:   fprintf(f, "\tcmp r0, #0\n\tbeq .L%d\n", (int *) pc[1] - text); break;
+	case BNZ:  fprintf(f, "\tcmp r0, #0\n\tbne .L%d\n", (int *) pc[1] - text); break;
+	case ENT:
+		fprintf(f, "\tpush {r7}\n\tmov r7, sp\n");
+		arm_addi(f, "sp", "sp", -pc[1] * 4);
+		break;
+	case TAIL:
+		for (i = 0; i < pc[1]; i++)
+			fprintf(f, "\tldr r1, [sp, #%d]\n\tstr r1, [r7, #%d]\n", i * 4, i * 4 + 8);
+		fprintf(f, "\tldr r2, [r7]\n\tmov sp, r7\n\tadd sp, sp, #4\n\tmov r7, r2\n\tpop {lr}\n");
+		break;
+	case ADJ:  arm_addi(f, "sp", "sp", pc[1] * 4); break;
+	case LEV:  fprintf(f, "\tmov sp, r7\n\tpop {r7, pc}\n"); break;
+	case RET:  fprintf(f, "\tpop {pc}\n"); break;
+	case LW:   fprintf(f, "\tldr r0, [r0]\n"); break;
+	case LC:   fprintf(f, "\tldrsb r0, [r0]\n"); break;
+	case SW:   fprintf(f, "\tpop {r1}\n\tstr r0, [r1]\n"); break;
+	case SC:   fprintf(f, "\tpop {r1}\n\tstrb r0, [r1]\n\tsxtb r0, r0\n"); break;
+	case PUSH: fprintf(f, "\tpush {r0}\n"); break;
+	case OPEN: arm_libc(f, "open", 0, 2, 2); break;
+	case READ: arm_libc(f, "read", 0, 3, 3); break;
+	case CLOS: arm_libc(f, "close", 0, 1, 1); break;
+	case PRTF: arm_libc(f, "printf", 0, pc[1] == ADJ ? pc[2] : 1, 6); break;
+	case FPRT:
+		n = pc[1] == ADJ ? pc[2] : 2;
+		fprintf(f, "\tldr r1, [sp, #%d]\n\tmovw r0, #:lower16:stdout\n\tmovt r0, #:upper16:stdout\n"
+			"\tmovw r2, #:lower16:stderr\n\tmovt r2, #:upper16:stderr\n\tcmp r1, #2\n\tit eq\n\tmoveq r0, r2\n"
+			"\tldr r0, [r0]\n", (n - 1) * 4);
+		arm_libc(f, "fprintf", 1, n - 1, 6);
+		break;
+	case MALC: arm_libc(f, "malloc", 0, 1, 1); break;
+	case MSET: arm_libc(f, "memset", 0, 3, 3); break;
+	case MCMP: arm_libc(f, "memcmp", 0, 3, 3); break;
+	case EXIT: arm_libc(f, "exit", 0, 1, 1); break;
+	default:
+		fprintf(f, "\tpop {r1}\n");
+		switch (*pc) {
+		case OR:  fprintf(f, "\torrs r0, r1\n"); break;
+		case XOR: fprintf(f, "\teors r0, r1\n"); break;
+		case AND: fprintf(f, "\tands r0, r1\n"); break;
+		case EQ:
+		case NEQ:
+		case LT:
+		case GT:
+		case LE:
+		case GE:
+			i = *pc - EQ;
+			fprintf(f, "\tcmp r1, r0\n\tite %s\n\tmov%s r0, #1\n\tmov%s r0, #0\n", cc[i], cc[i], inv[i]);
+			break;
+		case SHL: fprintf(f, "\tlsls r1, r0\n\tmovs r0, r1\n"); break;
+		case SHR: fprintf(f, "\tasrs r1, r0\n\tmovs r0, r1\n"); break;
+		case ADD: fprintf(f, "\tadds r0, r1, r0\n"); break;
+		case SUB: fprintf(f, "\tsubs r0, r1, r0\n"); break;
+		case MUL: fprintf(f, "\tmuls r0, r1\n"); break;
+		// ARMv7-A has no divide instruction to count on, the EABI helpers have one
+		case DIV: fprintf(f, "\tmov r2, r0\n\tmov r0, r1\n\tmov r1, r2\n\tbl __aeabi_idiv\n"); break;
+		case MOD: fprintf(f, "\tmov r2, r0\n\tmov r0, r1\n\tmov r1, r2\n\tbl __aeabi_idivmod\n\tmov r0, r1\n"); break;
+		}
 	}
-	if (argc < 1) {
-		err_exit("usage:\n"
-			 "./rvxcc [--dump-ir] <src>\n");
+}
+
+void arm_call(FILE *f, struct ident *d, int tail) {
+	fprintf(f, "\t%s mx_%.*s\n", tail ? "b" : "bl", d->hash & 0x3f, d->name);
+}
+
+struct target targets[] = {
+	{"rv32", rv_begin, rv_entry, rv_op, rv_call, rv_vec, rv_post},
+	{"x86_64", x64_begin, x64_entry, x64_op, x64_call, 0, 0},
+	{"arm", arm_begin, arm_entry, arm_op, arm_call, 0, 0},
+	{0}
+};
+
+/*
+ * parse_targets() - select the comma separated targets of --targets=
+ */
+void parse_targets(char *s) {
+	struct target *t;
+	char errstr[128];
+	int n;
+
+	target_mask = 0;
+	while (*s) {
+		for (n = 0; s[n] && s[n] != ','; n++)
+			;
+		for (t = targets; t->name && (strncmp(t->name, s, n) || t->name[n]); t++)
+			;
+		if (!t->name) {
+			snprintf(errstr, sizeof(errstr), "error - unknown target %.*s, there are rv32, x86_64 and arm\n", n, s);
+			err_exit(errstr);
+		}
+		target_mask |= 1 << (t - targets);
+		s += n + !!s[n];
 	}
+}
 
-	pool_size = 256 * 1024;
-	if (!(src = malloc(pool_size))) {
-		err_exit("error - couldn't malloc for source code text.\n");
+/*
+ * parse_pipeline() - set the RV32 pipeline model of --rv-pipeline=
+ */
+void parse_pipeline(char *s) {
+	int n;
+
+	n = -1;
+	sscanf(s, "%d,%d,%d,%d%n", &rv_model.load, &rv_model.mul, &rv_model.div, &rv_model.issue, &n);
+	if (n < 0 || s[n] || rv_model.load < 1 || rv_model.mul < 1 || rv_model.div < 1 || rv_model.issue < 1)
+		err_exit("error - --rv-pipeline takes the cycles <load>,<mul>,<div> and the <issue> width\n");
+}
+
+// the source file the outputs are named after, and the end of its text
+char *target_src;
+int *target_end;
+
+/*
+ * lower_thread() - lower the text of the program for one target
+ */
+void *lower_thread(void *arg) {
+	struct target *t;
+	char path[PATH_MAX], *buf;
+	size_t len;
+	FILE *f;
+	int *pc, prev, ev, failed;
+
+	t = &targets[(int) arg];
+	trace_tid = (int) arg + 1;
+	snprintf(path, sizeof(path), "%s.%s.s", target_src, t->name);
+	if (!(f = open_memstream(&buf, &len)))
+		return (void *) 1;
+	ev = trace_begin("lower", t->name, -1);
+	t->begin(f);
+	prev = 0;
+	for (pc = text + 1; pc <= target_end; prev = *pc, pc += *pc <= ADJ ? 2 : 1) {
+		if (tgt_func[pc - text]) {
+			fprintf(f, "\t.p2align 2\n");
+			tgt_name(f, (int) pc);
+			fprintf(f, ":\n");
+			t->entry(f);
+		}
+		if (tgt_label[pc - text])
+			fprintf(f, ".L%d:\n", pc - text);
+		if (*pc == CALL || (*pc == JMP && prev == TAIL))
+			t->call(f, tgt_func[(int *) pc[1] - text], *pc == JMP);
+		else if (*pc == VEC) {
+			if (t->vec && pc[1])
+				t->vec(f, pc);
+		}
+		else
+			t->op(f, pc);
 	}
-	
-	if (!(sym = malloc(pool_size))) {
-		err_exit("error - couldn't malloc for symbol table.\n");
+	tgt_data(f);
+	fclose(f);
+	failed = t->post && t->post(&buf, &len);
+	trace_end(ev);
+	if (failed) {
+		free(buf);
+		return (void *) 1;
 	}
+	// written by the writer thread while the next file compiles
+	io_write(path, buf, len);
+	return 0;
+}
 
-	if (!(stack = stack_p = malloc(pool_size))) {
-		err_exit("error - couldn't malloc for stack segment.\n");
-	}
+/*
+ * lower_targets() - write the program in the assembly of every selected
+ * target, each on a thread of its own
+ *
+ * The text and the data are left as they are, so the threads share them
+ * as they stand and the program can still run afterwards.
+ */
+void lower_targets(char *path) {
+	pthread_t threads[sizeof(targets) / sizeof(struct target)];
+	struct ident *d;
+	int *pc, i, n;
+	void *ret;
+
+	n = text_p + 2 - text;
+	if (!(tgt_label = calloc(n, 1)) || !(tgt_func = calloc(n, sizeof(struct ident *))))
+		err_exit("error - couldn't malloc for the targets\n");
+	for (pc = text + 1; pc <= text_p; pc += *pc <= ADJ ? 2 : 1)
+		if (*pc == JMP || *pc == BZ || *pc == BNZ)
+			tgt_label[(int *) pc[1] - text] = 1;
+	for (d = sym_user; d->token; d++)
+		if (d->class == Func && d->val)
+			tgt_func[(int *) d->val - text] = d;
+	if (id_main->class == Func && id_main->val)
+		tgt_func[(int *) id_main->val - text] = id_main;
+
+	target_src = path;
+	target_end = text_p;
+	for (i = 0; targets[i].name; i++)
+		if (target_mask & 1 << i)
+			pthread_create(&threads[i], 0, lower_thread, (void *) i);
+	n = 0;
+	for (i = 0; targets[i].name; i++)
+		if (target_mask & 1 << i) {
+			pthread_join(threads[i], &ret);
+			if (ret) {
+				fprintf(stderr, "error - couldn't lower %s for %s\n", path, targets[i].name);
+				n = 1;
+			}
+		}
+	free(tgt_label);
+	free(tgt_func);
+	if (n)
+		err_exit("error - the targets weren't lowered\n");
+}
+
+/*
+ * compile_args() - handle the compiler flags and compile every source file
+ */
+int compile_args(int argc, char **argv) {
+	int run_prog, stats, ret, ev, n;
 
-	if (!(data = data_p = malloc(pool_size))) {
-		err_exit("error - couldn't malloc for data segment.\n");
+	dump_ir = run_prog = stats = keep_frames = whole_program = lazy_bodies = reg_vm = 0;
+	gen_jobs = 1;
+	time_trace = profile = pgo_gen = pgo_use = 0;
+	target_mask = 0;
+	rv_model = rv_default;
+	emit_module = 0;
+	mod_close();
+	pgo_nmarks = pgo_nprof = 0;
+	while (argc > 0 && !strncmp(*argv, "--", 2)) {
+		if (!strcmp(*argv, "--dump-ir"))
+			dump_ir = 1;
+		else if (!strcmp(*argv, "--time-trace"))
+			time_trace = "maxcc-trace.json";
+		else if (!strncmp(*argv, "--time-trace=", 13))
+			time_trace = *argv + 13;
+		else if (!strcmp(*argv, "--run"))
+			run_prog = 1;
+		else if (!strcmp(*argv, "--stats"))
+			stats = 1;
+		else if (!strcmp(*argv, "--keep-frames"))
+			keep_frames = 1;
+		else if (!strcmp(*argv, "--whole-program"))
+			whole_program = 1;
+		else if (!strcmp(*argv, "--lazy"))
+			lazy_bodies = 1;
+		else if (!strcmp(*argv, "--reg-vm"))
+			reg_vm = 1;
+		else if (!strncmp(*argv, "--targets=", 10))
+			parse_targets(*argv + 10);
+		else if (!strncmp(*argv, "--rv-pipeline=", 14))
+			parse_pipeline(*argv + 14);
+		else if (!strncmp(*argv, "--module=", 9))
+			mod_open(*argv + 9);
+		else if (!strncmp(*argv, "--emit-module=", 14))
+			emit_module = *argv + 14;
+		else if (!strncmp(*argv, "--jobs=", 7))
+			gen_jobs = atoi(*argv + 7);
+		else if (!strcmp(*argv, "--profile")) {
+			profile = "maxcc-profile.folded";
+			run_prog = 1;
+		}
+		else if (!strncmp(*argv, "--profile=", 10)) {
+			profile = *argv + 10;
+			run_prog = 1;
+		}
+		else if (!strncmp(*argv, "--pgo-gen=", 10)) {
+			pgo_gen = *argv + 10;
+			run_prog = 1;
+		}
+		else if (!strncmp(*argv, "--pgo-use=", 10))
+			pgo_use = *argv + 10;
+		else
+			break;
+		--argc; ++argv;
+	}
+	if (argc < 1 || !strncmp(*argv, "--", 2)) {
+		err_exit("usage:\n"
+			 "./maxcc [options] <src>...\n"
+			 "./maxcc [options] --run <src> [args]...\n"
+			 "./maxcc --whole-program [options] [--run] <src>... [-- args...]\n"
+			 "./maxcc --server <socket>\n"
+			 "./maxcc --connect <socket> [options] <src>...\n"
+			 "options: --dump-ir --stats --keep-frames --jobs=<n> --lazy --reg-vm --time-trace[=<file>]\n"
+			 "\t --profile[=<file>] --pgo-gen=<file> --pgo-use=<file> --targets=<target>[,<target>]...\n"
+			 "\t --rv-pipeline=<load>,<mul>,<div>,<issue> --module=<file> --emit-module=<file>\n");
 	}
+	// the profiles count the instructions of the stack form
+	if (reg_vm && (profile || pgo_gen || pgo_use))
+		err_exit("error - --reg-vm can't be used with --profile or --pgo-*\n");
+	// the targets lower the stack form
+	if (reg_vm && target_mask)
+		err_exit("error - --reg-vm can't be used with --targets\n");
+	// a module is the stack form of a single unit
+	if ((reg_vm || whole_program) && (modules || emit_module))
+		err_exit("error - --reg-vm and --whole-program can't be used with modules\n");
+	if (emit_module && !run_prog && argc > 1)
+		err_exit("error - --emit-module takes a single source\n");
+	// loops are described for the vectorizer when RISC-V is a target
+	if ((vec_loops = target_mask & 1) && !vec_pool && !(vec_pool = malloc(pool_size)))
+		err_exit("error - couldn't malloc for the vector loops\n");
 
-	if (!(text = text_p = malloc(pool_size))) {
-		err_exit("error - couldn't malloc for text segment.\n");
+	if (time_trace) {
+		clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+		trace_cnt = 0;
 	}
+	if (pgo_use)
+		pgo_read();
+	// profiles are collected and applied in one thread
+	if (pgo_gen || pgo_use)
+		gen_jobs = 1;
 
-	if (!(type_size = malloc(PTR * sizeof(int)))) {
-		err_exit("error - couldn't malloc for type size table\n");
+	if (whole_program) {
+		// the sources end at "--", the program is named after the first one
+		for (n = 0; n < argc && strcmp(argv[n], "--"); n++)
+			;
+		io_prefetch(n, argv);
+		compile_program(n, argv);
+		if (target_mask)
+			lower_targets(*argv);
+		if (n < argc) {
+			argv[n] = *argv;
+			argc -= n;
+			argv += n;
+		}
+		else
+			argc = 1;
 	}
 
-	if (!(members = malloc(PTR * sizeof(struct ident *)))) {
-		err_exit("error - couldn't malloc for struct member table\n");
+	if (run_prog) {
+		// the arguments after the source file belong to the program
+		if (!whole_program) {
+			compile_file(*argv);
+			if (emit_module)
+				mod_emit(emit_module);
+			if (target_mask)
+				lower_targets(*argv);
+		}
+		fflush(stdout);
+		ev = trace_begin("run", *argv, -1);
+		ret = run(argc, argv);
+		trace_end(ev);
+		if (stats)
+			fprintf(stderr, "instructions: %d\n", cycle);
+		if (profile)
+			profile_report();
+		if (pgo_gen)
+			pgo_write();
+		io_finish();
+		if (time_trace)
+			trace_write();
+		return ret;
 	}
 
-	if (!(ast = malloc(pool_size))) {
-		err_exit("error - couldn;t malloc for abstract syntax tree\n");
+	if (!whole_program)
+		io_prefetch(argc, argv);
+	while (argc && !whole_program) {
+		compile_file(*argv);
+		if (emit_module)
+			mod_emit(emit_module);
+		if (target_mask)
+			lower_targets(*argv);
+		--argc; ++argv;
 	}
+	fflush(stdout);
+	io_finish();
+	if (time_trace)
+		trace_write();
+	return 0;
+}
 
-	memset(src, 0, pool_size);
-	memset(sym, 0, pool_size);
-	memset(type_size, 0, PTR * sizeof(int));
-	memset(members, 0, PTR * sizeof(struct ident *));
-	memset(ast, 0, pool_size);
+/*
+ * serve() - compile requests from a Unix socket with a warm compiler context
+ *
+ * A request is a record "r <n>\n" followed by n bytes of NUL terminated
+ * words: the working directory of the client, then the arguments the
+ * command line takes, e.g. "/home/me\0--dump-ir\0main.c\0". Words may
+ * hold any byte but NUL, and a request over SERVE_REQUEST bytes is
+ * refused. Every request is compiled in a forked
+ * child which inherits the seeded symbol table and pools, so an err_exit()
+ * only ends that job. The child runs in the client's directory, so every
+ * path in the request means what it would there. Its stdout and stderr are
+ * sent back as records "o <n>\n" and "e <n>\n", each followed by n bytes,
+ * and the last record is "x <status>\n".
+ */
+enum {SERVE_REQUEST = 1 << 20};
 
-	ast_ptr = (int *)((int)ast + pool_size);
+/*
+ * serve_refuse() - answer a job with an error and its exit status
+ */
+void serve_refuse(int conn, char *msg) {
+	dprintf(conn, "e %d\n%s", (int) strlen(msg), msg);
+	dprintf(conn, "x 1\n");
+	exit(1);
+}
 
-	p = "break continue case char default else enum if int return "
-	    "sizeof struct union switch for while do goto void main "
-	    "open read close printf fprintf malloc memset memcmp exit";
+int serve(char *path) {
+	struct sockaddr_un addr;
+	struct pollfd p[2];
+	int fd, conn, len, status, job_argc, out[2], err[2], i, n;
+	char head[32], *req, **job_argv, *r, buf[4096];
+	pid_t pid;
 
-	// C Keywords
-	for (i = Break; i < Goto; i++) {
-		next();
-		id->token = i;
-		id->class = Keyword;
-	}
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		err_exit("error - couldn't create the server socket\n");
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 64) < 0)
+		err_exit("error - couldn't listen on the server socket\n");
 
-	// void
-	next();
-	id->token = Char;
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGCHLD, SIG_IGN);
 
-	// main
-	next();
-	id_main = id;
+	while (1) {
+		if ((conn = accept(fd, 0, 0)) < 0)
+			continue;
+		if (fork()) {
+			close(conn);
+			continue;
+		}
 
-	// Syscalls / C std funcs
-	for (i = OPEN; i < EXIT; i++) {
-		next();
-		id->type = INT;
-		id->class = Syscall;
-		id->val = i;
-	}
+		// job process: read the request and run it in a fresh child
+		close(fd);
+		signal(SIGCHLD, SIG_DFL);
+		len = 0;
+		while (len < sizeof(head) - 1 && read(conn, head + len, 1) == 1 && head[len] != '\n')
+			len++;
+		head[len] = 0;
+		if (sscanf(head, "r %d", &len) != 1 || len < 1)
+			serve_refuse(conn, "error - bad request\n");
+		if (len > SERVE_REQUEST)
+			serve_refuse(conn, "error - request too long\n");
+		if (!(req = malloc(len)) || !(job_argv = malloc((len + 1) * sizeof(char *))))
+			serve_refuse(conn, "error - couldn't malloc for the request\n");
+		for (i = 0; i < len && (n = read(conn, req + i, len - i)) > 0; i += n)
+			;
+		if (i < len || req[len - 1])
+			serve_refuse(conn, "error - truncated request\n");
 
-	type_size[type_new++] = sizeof(char);
-	type_size[type_new++] = sizeof(int);
+		job_argc = 0;
+		for (r = req; r < req + len; r += strlen(r) + 1)
+			job_argv[job_argc++] = r;
+		job_argv[job_argc] = 0;
+		if (pipe(out) < 0 || pipe(err) < 0)
+			serve_refuse(conn, "error - couldn't create the job pipes\n");
 
-	while (argc) {
-		int fd = open(*argv, 0);
-		int i = 0;
-		if (fd < 0) {
-			fprintf(stderr, "error - for source file %s\n", *argv);
-			err_exit("couldn't open the source file.\n");
+		if (!(pid = fork())) {
+			dup2(out[1], 1);
+			dup2(err[1], 2);
+			close(out[0]);
+			close(out[1]);
+			close(err[0]);
+			close(err[1]);
+			close(conn);
+			if (chdir(*job_argv)) {
+				fprintf(stderr, "error - couldn't change to %s\n", *job_argv);
+				exit(1);
+			}
+			exit(compile_args(job_argc - 1, job_argv + 1));
 		}
+		close(out[1]);
+		close(err[1]);
 
-		if ((i = read(fd, src, pool_size - 1)) <= 0) {
-			fprintf(stderr, "error - for source file %s\n", *argv);
-			err_exit("unable to read the source file\n");
+		// pass both streams on until the job has closed them
+		p[0].fd = out[0];
+		p[1].fd = err[0];
+		p[0].events = p[1].events = POLLIN;
+		while (p[0].fd >= 0 || p[1].fd >= 0) {
+			if (poll(p, 2, -1) < 0)
+				break;
+			for (i = 0; i < 2; i++) {
+				if (p[i].fd < 0 || !p[i].revents)
+					continue;
+				if ((n = read(p[i].fd, buf, sizeof(buf))) <= 0) {
+					close(p[i].fd);
+					p[i].fd = -1;
+					continue;
+				}
+				dprintf(conn, "%c %d\n", i ? 'e' : 'o', n);
+				write(conn, buf, n);
+			}
 		}
-		memset(stack, 0, pool_size);
-		memset(data, 0, pool_size);
-		memset(text, 0, pool_size);
 
-		src[i] = 0;
-		close(fd);
-		last_p = p = src;
-		line = 1;
+		status = 1;
+		if (pid > 0 && waitpid(pid, &status, 0) == pid)
+			status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		dprintf(conn, "x %d\n", status);
+		close(conn);
+		exit(0);
+	}
+	return 0;
+}
 
-		program();
+/*
+ * connect_server() - send a compile request to a running server
+ *
+ * The request starts with our working directory, which the job runs in,
+ * and every word goes as it is, spaces included.
+ * The records of the reply go to our stdout and stderr and the exit status
+ * of the job becomes ours.
+ */
+int connect_server(char *path, int argc, char **argv) {
+	struct sockaddr_un addr;
+	int fd, n, k;
+	char cwd[PATH_MAX], head[64], buf[4096], tag;
+	FILE *f, *out;
 
-		--argc; ++argv;
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		err_exit("error - couldn't create the client socket\n");
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		err_exit("error - couldn't connect to the server\n");
+	if (!getcwd(cwd, sizeof(cwd)))
+		err_exit("error - couldn't get the working directory\n");
+
+	n = strlen(cwd) + 1;
+	for (k = 0; k < argc; k++)
+		n += strlen(argv[k]) + 1;
+	dprintf(fd, "r %d\n", n);
+	write(fd, cwd, strlen(cwd) + 1);
+	while (argc--) {
+		write(fd, *argv, strlen(*argv) + 1);
+		argv++;
+	}
+
+	if (!(f = fdopen(fd, "r")))
+		err_exit("error - couldn't read from the server\n");
+	while (fgets(head, sizeof(head), f) && sscanf(head, "%c %d", &tag, &n) == 2) {
+		if (tag == 'x') {
+			fclose(f);
+			return n;
+		}
+		out = tag == 'e' ? stderr : stdout;
+		while (n > 0 && (k = fread(buf, 1, n < sizeof(buf) ? n : sizeof(buf), f)) > 0) {
+			fwrite(buf, 1, k, out);
+			n -= k;
+		}
+		fflush(out);
 	}
+	err_exit("error - truncated response from the server\n");
+	return 1;
+}
+
+#ifndef MAXCC_NO_MAIN
+int main(int argc, char **argv) {
+	int ret;
+
+	--argc; ++argv;
+	if (argc > 1 && !strcmp(*argv, "--connect"))
+		return connect_server(argv[1], argc - 2, argv + 2);
+
+	init_compiler();
+
+	if (argc > 1 && !strcmp(*argv, "--server"))
+		ret = serve(argv[1]);
+	else
+		ret = compile_args(argc, argv);
 
 	free(src);
 	free(sym);
 	free(stack);
-	free(data);
+	free(rodata);
+	free(bss);
 	free(text);
 	free(type_size);
-	free(members);
+	free(type_align);
+	free(layouts);
+	free(ast);
+	free(funcs);
+	free(tu_jumps);
 
-	return 0;
+	return ret;
 }
+#endif
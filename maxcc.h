@@ -0,0 +1,61 @@
+/*
+ * maxcc.h - the maxcc compiler as a library (libmaxcc)
+ *
+ * A context holds the results of its last compile: the text segment, the
+ * .rodata and .bss sections, the --dump-ir listing and the diagnostics. Nothing in the
+ * library calls exit(), an error in the source comes back as a diagnostic.
+ *
+ * Contexts are not independent compilers. There is one compiler per
+ * process, with its pools, symbol table and error state, and a compile
+ * holds it to itself: compiles from several contexts or threads run one
+ * after the other, never in parallel. A context only owns the copies of
+ * its results, which stay valid until its next compile or reset.
+ *
+ *	maxcc_ctx *c = maxcc_create();
+ *	if (maxcc_compile(c, src, len, MAXCC_DUMP_IR) < 0)
+ *		printf("%d: %s", maxcc_diag_line(c, 0), maxcc_diag_message(c, 0));
+ *	else
+ *		fputs(maxcc_ir(c), stdout);
+ *	maxcc_destroy(c);
+ */
+#ifndef MAXCC_H
+#define MAXCC_H
+
+#define MAXCC_API __attribute__((visibility("default")))
+
+// flags of maxcc_compile()
+enum {
+	MAXCC_DUMP_IR = 1,	// keep the listing for maxcc_ir()
+	MAXCC_REG_VM = 2	// emit the register form
+};
+
+typedef struct maxcc_ctx maxcc_ctx;
+
+// returns 0 when the compiler couldn't allocate its pools
+MAXCC_API maxcc_ctx *maxcc_create(void);
+MAXCC_API void maxcc_destroy(maxcc_ctx *c);
+
+// compile len bytes of src as one translation unit, returns 0 or -1 on an error
+MAXCC_API int maxcc_compile(maxcc_ctx *c, const char *src, int len, int flags);
+
+// drop the results of the last compile
+MAXCC_API void maxcc_reset(maxcc_ctx *c);
+
+// The segments as they were laid out at address *base, so that the
+// addresses in them can be relocated. The text is in words, .rodata holds
+// the string literals and .bss, the globals, is all zero and only has a size.
+MAXCC_API const int *maxcc_text(maxcc_ctx *c, int *words, int *base);
+MAXCC_API const char *maxcc_rodata(maxcc_ctx *c, int *bytes, int *base);
+MAXCC_API int maxcc_bss(maxcc_ctx *c, int *base);
+
+// the word main() starts at in the text, or -1
+MAXCC_API int maxcc_entry(maxcc_ctx *c);
+
+// the --dump-ir listing, "" without MAXCC_DUMP_IR
+MAXCC_API const char *maxcc_ir(maxcc_ctx *c);
+
+MAXCC_API int maxcc_diag_count(maxcc_ctx *c);
+MAXCC_API int maxcc_diag_line(maxcc_ctx *c, int i);
+MAXCC_API const char *maxcc_diag_message(maxcc_ctx *c, int i);
+
+#endif
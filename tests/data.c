@@ -0,0 +1,31 @@
+char *greeting;
+int counter;
+char flag;
+struct pt {
+	int x;
+	char c;
+	struct pt *next;
+};
+struct pt origin;
+
+int bump(int n) {
+	counter = counter + n;
+	return counter;
+}
+
+int main() {
+	char *s;
+	int i;
+
+	greeting = "hello, rodata";
+	s = "abc";
+	printf("%s %d %d %d\n", greeting, counter, flag, origin.x);
+	for (i = 0; i < 5; i++)
+		bump(i);
+	flag = 'z';
+	origin.x = 42;
+	origin.next = &origin;
+	printf("%d %c %d %c\n", counter, flag, origin.next->x, s[2]);
+	printf("%d\n", sizeof(struct pt));
+	return 0;
+}
@@ -0,0 +1,30 @@
+// Only the functions main() reaches are parsed under --lazy.
+struct pair {
+	int a;
+	int b;
+};
+int calls;
+
+int unused(int x) {
+	return x * unused(x - 1);
+}
+
+int add(struct pair *p) {
+	calls = calls + 1;
+	return p->a + p->b;
+}
+
+int twice(struct pair *p) {
+	return add(p) + add(p);
+}
+
+int main() {
+	struct pair p;
+	int s;
+
+	p.a = 3;
+	p.b = 4;
+	s = twice(&p);
+	printf("%d %d\n", s, calls);
+	return 0;
+}
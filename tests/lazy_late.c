@@ -0,0 +1,10 @@
+// A lazy body sees the declarations before it, like a normal parse.
+int f() {
+	return later;
+}
+
+int later;
+
+int main() {
+	return f();
+}
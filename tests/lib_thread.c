@@ -0,0 +1,50 @@
+/*
+ * lib_thread.c - compile with libmaxcc from a thread that didn't create
+ * the context, switch and loop jumps included
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "../maxcc.h"
+
+char *prog =
+	"int main() {\n"
+	"	int i, n;\n"
+	"	n = 0;\n"
+	"	for (i = 0; i < 10; i++) {\n"
+	"		if (i == 7)\n"
+	"			break;\n"
+	"		switch (i) {\n"
+	"		case 1: n = n + 1; break;\n"
+	"		case 2: continue;\n"
+	"		default: n = n + 10;\n"
+	"		}\n"
+	"	}\n"
+	"	return n;\n"
+	"}\n";
+
+void *compile(void *arg) {
+	maxcc_ctx *c = arg;
+
+	if (maxcc_compile(c, prog, strlen(prog), 0) < 0 || maxcc_entry(c) < 0) {
+		printf("%d: %s", maxcc_diag_line(c, 0), maxcc_diag_message(c, 0));
+		return c;
+	}
+	return 0;
+}
+
+int main() {
+	maxcc_ctx *c;
+	pthread_t t;
+	void *failed;
+
+	if (!(c = maxcc_create()) || pthread_create(&t, 0, compile, c))
+		return 1;
+	pthread_join(t, &failed);
+	// and once more on the thread that created it
+	if (failed || compile(c))
+		return 1;
+	maxcc_destroy(c);
+	printf("lib_thread: ok\n");
+	return 0;
+}
@@ -0,0 +1,40 @@
+enum {RED, GREEN = 5, BLUE,};
+struct pt {
+	int x;
+	char c;
+	struct pt *next;
+};
+int counter;
+char *greeting;
+struct pt origin;
+
+int sq(int a) {
+	return a * a;
+}
+
+int sum_to(int n) {
+	int s;
+	s = 0;
+	while (n > 0) {
+		s = s + sq(n);
+		n--;
+	}
+	counter = counter + 1;
+	return s;
+}
+
+int hello() {
+	greeting = "hello from the module";
+	printf("%s %d\n", greeting, BLUE);
+	return GREEN;
+}
+
+int chain(struct pt *p) {
+	int n;
+	n = 0;
+	while (p) {
+		n = n + p->x + p->c;
+		p = p->next;
+	}
+	return n;
+}
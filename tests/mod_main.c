@@ -0,0 +1,21 @@
+int counter;
+struct pt {
+	int x;
+	char c;
+	struct pt *next;
+};
+int sum_to(int n);
+
+int main() {
+	struct pt a;
+	struct pt *b;
+	b = malloc(sizeof(struct pt));
+	a.x = 3; a.c = 4; a.next = b;
+	b->x = 10; b->c = 1; b->next = 0;
+	printf("%d %d\n", sum_to(10), sq(7));
+	printf("%d %d\n", hello(), counter);
+	printf("%d %d %d\n", chain(&a), sizeof(struct pt), RED + BLUE);
+	origin.x = 9;
+	printf("%s %d\n", greeting, origin.x);
+	return 0;
+}
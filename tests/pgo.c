@@ -0,0 +1,15 @@
+// The rare arm of f() is a cold block under --pgo-use. f() has no frame,
+// so the arm addresses a and b from sp with b still pushed.
+int f(int a, int b, int c) {
+	return b + (b > c ? a * 2 : b - a);
+}
+
+int main() {
+	int i, s;
+
+	s = 0;
+	for (i = 0; i < 1000; i++)
+		s = s + f(i, i == 500 ? 3 : -1, 0);
+	printf("%d %d\n", s, f(7, 1, 0));
+	return 0;
+}
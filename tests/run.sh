@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# run.sh - run the test programs and compare what they print
+#
+# $ tests/run.sh
+#
+# Every program in PROGS is run under every mode in MODES ("vm" or the
+# flags passed next to --run) and has to print tests/<program>.out. The
+# other checks each cover one feature: profile guided optimization, the
+# errors of --lazy, precompiled modules, the compile server and the RISC-V
+# vectorizer. A check whose output differs is shown as a diff.
+
+MAXCC=${MAXCC:-./maxcc}
+PROGS=${PROGS:-"main vec data lazy pgo"}
+MODES=${MODES:-"vm --reg-vm --jobs=4 --lazy"}
+
+tmp=$(mktemp -d)
+server=
+trap '[ -n "$server" ] && kill $server; rm -rf $tmp' EXIT
+
+fail=0
+count=0
+
+# check <name> <expected file> - compare $tmp/out, the output of the
+# command just run, with the expected file
+check() {
+	count=$((count + 1))
+	if ! diff -u $2 $tmp/out > $tmp/diff; then
+		echo "FAIL $1"
+		cat $tmp/diff
+		fail=$((fail + 1))
+	fi
+}
+
+for prog in $PROGS; do
+	for mode in $MODES; do
+		[ $mode = vm ] && flags= || flags=$mode
+		$MAXCC $flags --run tests/$prog.c > $tmp/out 2>&1
+		check "$prog $mode" tests/$prog.out
+	done
+done
+
+# the profile of one run lays out the next, the rare arm goes out of line
+$MAXCC --pgo-gen=$tmp/pgo.prof --run tests/pgo.c > /dev/null 2>&1
+$MAXCC --pgo-use=$tmp/pgo.prof --run tests/pgo.c > $tmp/out 2>&1
+check "pgo profile" tests/pgo.out
+
+# a skipped body can't use what is declared after it
+$MAXCC --lazy --run tests/lazy_late.c > $tmp/out 2>&1
+check "lazy late declaration" tests/lazy_late.out
+
+# a unit linked with a module uses its functions, globals, enums and structs
+$MAXCC --emit-module=$tmp/lib.mxm tests/mod_lib.c > $tmp/out 2>&1 &&
+	$MAXCC --module=$tmp/lib.mxm --run tests/mod_main.c > $tmp/out 2>&1
+check "module" tests/mod_main.out
+
+# the server runs the job in the client's directory and passes on its status
+$MAXCC --server $tmp/sock > /dev/null 2>&1 &
+server=$!
+i=0
+while [ ! -S $tmp/sock ] && [ $i -lt 50 ]; do
+	sleep 0.1
+	i=$((i + 1))
+done
+$MAXCC --connect $tmp/sock --run tests/main.c > $tmp/out 2>&1
+echo "status $?" >> $tmp/out
+$MAXCC --connect $tmp/sock --run tests/lazy_late.c >> $tmp/out 2>&1
+echo "status $?" >> $tmp/out
+check "server" tests/server.out
+
+# the RISC-V output of vec.c runs its element-wise loops with vsetvli
+cp tests/vec.c $tmp/vec.c
+$MAXCC --targets=rv32 $tmp/vec.c > /dev/null 2>&1
+grep -c vsetvli $tmp/vec.c.rv32.s > $tmp/out
+check "vec rv32" tests/vec_rv32.out
+
+echo "$fail of $count checks failed"
+[ $fail -eq 0 ]
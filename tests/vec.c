@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+int sum(char *p, int n) {
+	int i, s;
+
+	s = 0;
+	for (i = 0; i < n; i++)
+		s = s + p[i];
+	return s;
+}
+
+int main(void) {
+	int *a, *b, i, n, s;
+	char *p, *q;
+
+	n = 300;
+	a = malloc(300 * sizeof(int));
+	b = malloc(300 * sizeof(int));
+	p = malloc(300);
+	q = malloc(300);
+
+	for (i = 0; i < n; i++)
+		a[i] = i * 7 - 100;
+	for (i = 0; i < n; i++)
+		b[i] = (a[i] >> 2) ^ 3;
+	s = 0;
+	for (i = 0; i < n; i++)
+		s = s + b[i];
+	printf("%d\n", s);
+
+	// char lanes may only shift left, i >> 2 is taken from the whole int
+	for (i = 0; i < n; i++)
+		p[i] = i >> 2;
+	printf("%d\n", sum(p, n));
+	for (i = 0; i < n; i++)
+		q[i] = (p[i] << 1) + i;
+	printf("%d\n", sum(q, n));
+
+	return 0;
+}